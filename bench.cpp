@@ -0,0 +1,723 @@
+// Benchmarks for the sketch extensions; one mode per feature:
+//   ./bench weighted N phi
+//   ./bench concurrent N phi
+//   ./bench strings N phi
+//   ./bench sampled N phi
+//   ./bench calibrate N phi
+//   ./bench rowpar N phi
+//   ./bench reduce N phi
+//   ./bench notify N phi
+//   ./bench pool N phi
+
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <unistd.h>
+
+#include "sketching/sketch.hpp"
+#include "sketching/concurrent_sketch.hpp"
+#include "eval.hpp"
+#include "hashutil.h"
+#include "zipf.h"
+
+using namespace std::chrono;
+
+#define UNIVERSE 1ULL << 30
+#define EXP 1.5
+
+// byte-volume style weights in [1, MAX_WEIGHT]
+#define MAX_WEIGHT 64
+// every REFUND_EVERY-th update refunds (deletes) the previous one
+#define REFUND_EVERY 10
+// updates between snapshots for query-while-ingesting
+#define PUBLISH_INTERVAL (1ULL << 16)
+// precision and recall sampled ingestion has to hold
+#define TARGET_ACCURACY 0.99
+// failure probability targeted by calibrate
+#define DELTA 0.01
+// stream prefix calibrate times every fitting configuration on
+#define CALIBRATE_SAMPLE (1ULL << 20)
+// keys per row-partitioned AddBatch
+#define ROW_BATCH (1ULL << 20)
+// per-host sketches dumped for the offline reducer, all built from one seed
+#define HOSTS 64
+#define HOST_SEED 42
+// updates between HeavyHitters(phi) polls that ThresholdMonitor replaces
+#define POLL_INTERVALS {1ULL << 12, 1ULL << 16, 1ULL << 20}
+// tenants sharing one SketchPool, and each tenant's t x k table
+#define POOL_TENANTS 10000
+#define POOL_T 4
+#define POOL_K 256
+
+uint64_t *generate_stream(uint64_t N) {
+    uint64_t *numbers = (uint64_t *)malloc(N * sizeof(uint64_t));
+    if (!numbers) {
+        std::cerr << "Malloc numbers failed.\n";
+        exit(0);
+    }
+    high_resolution_clock::time_point t1, t2;
+    t1 = high_resolution_clock::now();
+    generate_random_keys(numbers, UNIVERSE, N, EXP);
+    t2 = high_resolution_clock::now();
+    std::cout << "Time to generate " << N << " items: " << elapsed(t1, t2) << " secs\n\n";
+    return numbers;
+}
+
+// weighted Add(x, w) against the O(w) loop of unit updates it replaces
+void bench_weighted_sketch(const char *name, Sketch& weighted, Sketch& looped,
+        const uint64_t *keys, const int64_t *deltas, uint64_t N, double phi, const HeavyHitterList& truth_hh) {
+    high_resolution_clock::time_point t1, t2;
+
+    t1 = high_resolution_clock::now();
+    for (uint64_t i = 0; i < N; ++i) {
+        weighted.Add(keys[i], deltas[i]);
+    }
+    t2 = high_resolution_clock::now();
+    double weighted_time = elapsed(t1, t2);
+
+    t1 = high_resolution_clock::now();
+    for (uint64_t i = 0; i < N; ++i) {
+        int64_t unit = deltas[i] > 0 ? 1 : -1;
+        for (int64_t j = 0; j < std::abs(deltas[i]); ++j) {
+            looped.Add(keys[i], unit);
+        }
+    }
+    t2 = high_resolution_clock::now();
+    double looped_time = elapsed(t1, t2);
+
+    auto precision_recall = compute_precision_recall(truth_hh, weighted.HeavyHitters(phi));
+    std::cout << name << ": weighted " << weighted_time << " secs, unit loop " << looped_time
+              << " secs (" << looped_time / weighted_time << "x), { Precision, Recall } : { "
+              << precision_recall.first << ", " << precision_recall.second << " }\n";
+}
+
+void bench_weighted(uint64_t N, double phi) {
+    uint64_t *numbers = generate_stream(N);
+
+    // weights drawn per update, with refunds of the previous update mixed in
+    int64_t *deltas = (int64_t *)malloc(N * sizeof(int64_t));
+    std::mt19937_64 gen(N);
+    std::uniform_int_distribution<int64_t> distrib_w(1, MAX_WEIGHT);
+    for (uint64_t i = 0; i < N; ++i) {
+        if (i % REFUND_EVERY == REFUND_EVERY - 1) {
+            numbers[i] = numbers[i - 1];
+            deltas[i] = -deltas[i - 1];
+        } else {
+            deltas[i] = distrib_w(gen);
+        }
+    }
+
+    ExactCounter truth(1);
+    for (uint64_t i = 0; i < N; ++i) {
+        truth.Add(numbers[i], deltas[i]);
+    }
+    HeavyHitterList truth_hh = truth.HeavyHitters(phi);
+    std::cout << "Net weight " << truth.StreamSize() << ", " << truth_hh.size() << " phi-heavy hitters\n";
+
+    CountSketch cs(8, 2048), cs_loop(8, 2048);
+    CountMinSketch cms(8, 1024), cms_loop(8, 1024);
+    MisraGries mg(3000), mg_loop(3000);
+    bench_weighted_sketch("Count Sketch", cs, cs_loop, numbers, deltas, N, phi, truth_hh);
+    bench_weighted_sketch("Count-Min Sketch", cms, cms_loop, numbers, deltas, N, phi, truth_hh);
+    bench_weighted_sketch("Misra-Gries", mg, mg_loop, numbers, deltas, N, phi, truth_hh);
+
+    free(deltas);
+    free(numbers);
+}
+
+// ingest throughput of S with a reader thread querying HeavyHitters at each rate
+template <class S, class... Args>
+void bench_concurrent_sketch(const char *name, const uint64_t *numbers, uint64_t N, double phi,
+        const HeavyHitterList& truth_hh, Args... args) {
+    high_resolution_clock::time_point t1, t2;
+
+    S plain(args...);
+    t1 = high_resolution_clock::now();
+    for (uint64_t i = 0; i < N; ++i) {
+        plain.Add(numbers[i]);
+    }
+    t2 = high_resolution_clock::now();
+    double baseline = N / elapsed(t1, t2);
+    std::cout << name << " without queries: " << baseline / 1e6 << " M items/sec\n";
+
+    // queries per second, 0 = wrapper overhead alone
+    for (uint64_t rate : {0, 10, 100, 1000, 10000}) {
+        ConcurrentSketch<S> sketch(PUBLISH_INTERVAL, args...);
+        std::atomic<bool> done(false);
+        uint64_t queries = 0;
+
+        std::thread reader([&]() {
+            if (rate == 0) {
+                return;
+            }
+            auto period = nanoseconds(1000000000ULL / rate);
+            auto next = high_resolution_clock::now();
+            while (!done.load(std::memory_order_relaxed)) {
+                sketch.HeavyHitters(phi);
+                queries++;
+                next += period;
+                std::this_thread::sleep_until(next);
+            }
+        });
+
+        t1 = high_resolution_clock::now();
+        for (uint64_t i = 0; i < N; ++i) {
+            sketch.Add(numbers[i]);
+        }
+        t2 = high_resolution_clock::now();
+        done.store(true);
+        reader.join();
+
+        double throughput = N / elapsed(t1, t2);
+        sketch.Publish();
+        auto precision_recall = compute_precision_recall(truth_hh, sketch.HeavyHitters(phi));
+        std::cout << name << " at " << rate << " queries/sec: " << throughput / 1e6 << " M items/sec ("
+                  << 100 * (1 - throughput / baseline) << "% loss, " << queries << " queries served), "
+                  << "{ Precision, Recall } : { " << precision_recall.first << ", " << precision_recall.second << " }\n";
+    }
+    std::cout << "\n";
+}
+
+void bench_concurrent(uint64_t N, double phi) {
+    uint64_t *numbers = generate_stream(N);
+
+    ExactCounter truth;
+    truth.AddBatch(numbers, N);
+    HeavyHitterList truth_hh = truth.HeavyHitters(phi);
+
+    bench_concurrent_sketch<CountSketch>("Count Sketch", numbers, N, phi, truth_hh, 8, 2048);
+    bench_concurrent_sketch<CountMinSketch>("Count-Min Sketch", numbers, N, phi, truth_hh, 8, 1024);
+    bench_concurrent_sketch<MisraGries>("Misra-Gries", numbers, N, phi, truth_hh, 3000);
+
+    free(numbers);
+}
+
+// string-key front end cost against hashing alone and the core sketch alone
+void bench_strings_sketch(const char *name, Sketch& core, Sketch& plain, const std::vector<std::string_view>& keys,
+        const uint64_t *fingerprints, double phi, const HeavyHitterList& truth_hh) {
+    high_resolution_clock::time_point t1, t2;
+    uint64_t N = keys.size();
+
+    t1 = high_resolution_clock::now();
+    for (uint64_t i = 0; i < N; ++i) {
+        plain.Add(fingerprints[i]);
+    }
+    t2 = high_resolution_clock::now();
+    double core_time = elapsed(t1, t2);
+
+    StringKeySketch sketch(core);
+    t1 = high_resolution_clock::now();
+    sketch.AddBatch(keys.data(), N);
+    t2 = high_resolution_clock::now();
+    double string_time = elapsed(t1, t2);
+
+    // every reported key must be the original bytes of its fingerprint
+    std::vector<StringHeavyHitter> hh = sketch.HeavyHitters(phi);
+    HeavyHitterList fingerprint_hh;
+    uint64_t resolved = 0;
+    for (const StringHeavyHitter& h : hh) {
+        resolved += sketch.Fingerprint(h.key) == h.fingerprint;
+        fingerprint_hh.push_back({h.fingerprint, h.estimate});
+    }
+    auto precision_recall = compute_precision_recall(truth_hh, fingerprint_hh);
+
+    std::cout << name << ": strings " << string_time * 1e9 / N << " ns/key, fingerprints only "
+              << core_time * 1e9 / N << " ns/key, " << resolved << "/" << hh.size() << " keys resolved, "
+              << sketch.Size() << " bytes of kept keys, { Precision, Recall } : { "
+              << precision_recall.first << ", " << precision_recall.second << " }\n";
+    if (!hh.empty()) {
+        std::cout << "  heaviest: " << hh[0].key << " (" << hh[0].estimate << ")\n";
+    }
+}
+
+void bench_strings(uint64_t N, double phi) {
+    uint64_t *numbers = generate_stream(N);
+    high_resolution_clock::time_point t1, t2;
+
+    // URL-like keys, back to back in one buffer
+    std::string bytes;
+    std::vector<uint64_t> ends(N);
+    for (uint64_t i = 0; i < N; ++i) {
+        bytes += "https://example.com/items/";
+        bytes += std::to_string(numbers[i]);
+        ends[i] = bytes.size();
+    }
+    free(numbers);
+    std::vector<std::string_view> keys(N);
+    for (uint64_t i = 0; i < N; ++i) {
+        uint64_t begin = i ? ends[i - 1] : 0;
+        keys[i] = std::string_view(bytes.data() + begin, ends[i] - begin);
+    }
+
+    uint64_t *fingerprints = (uint64_t *)malloc(N * sizeof(uint64_t));
+    t1 = high_resolution_clock::now();
+    for (uint64_t i = 0; i < N; ++i) {
+        fingerprints[i] = MurmurHash64A(keys[i].data(), keys[i].size(), 0);
+    }
+    t2 = high_resolution_clock::now();
+    std::cout << "Hashing alone: " << elapsed(t1, t2) * 1e9 / N << " ns/key\n";
+
+    ExactCounter truth;
+    truth.AddBatch(fingerprints, N);
+    HeavyHitterList truth_hh = truth.HeavyHitters(phi);
+
+    CountSketch cs(8, 2048), cs_plain(8, 2048);
+    CountMinSketch cms(8, 1024), cms_plain(8, 1024);
+    MisraGries mg(3000), mg_plain(3000);
+    bench_strings_sketch("Count Sketch", cs, cs_plain, keys, fingerprints, phi, truth_hh);
+    bench_strings_sketch("Count-Min Sketch", cms, cms_plain, keys, fingerprints, phi, truth_hh);
+    bench_strings_sketch("Misra-Gries", mg, mg_plain, keys, fingerprints, phi, truth_hh);
+
+    free(fingerprints);
+}
+
+// throughput and accuracy of S under sampled ingestion, for decreasing p
+template <class S, class... Args>
+void bench_sampled_sketch(const char *name, const uint64_t *numbers, uint64_t N, double phi,
+        const HeavyHitterList& truth_hh, Args... args) {
+    high_resolution_clock::time_point t1, t2;
+
+    S plain(args...);
+    t1 = high_resolution_clock::now();
+    for (uint64_t i = 0; i < N; ++i) {
+        plain.Add(numbers[i]);
+    }
+    t2 = high_resolution_clock::now();
+    double baseline = elapsed(t1, t2);
+    std::cout << name << " without sampling: " << N / baseline / 1e6 << " M items/sec\n";
+
+    double best_speedup = 1, best_p = 1;
+    for (double p : {0.5, 0.2, 0.1, 0.05, 0.02, 0.01, 0.005, 0.002, 0.001}) {
+        S inner(args...);
+        SampledSketch sketch(inner, p);
+
+        t1 = high_resolution_clock::now();
+        for (uint64_t i = 0; i < N; ++i) {
+            sketch.Add(numbers[i]);
+        }
+        t2 = high_resolution_clock::now();
+        double speedup = baseline / elapsed(t1, t2);
+
+        auto precision_recall = compute_precision_recall(truth_hh, sketch.HeavyHitters(phi));
+        std::cout << name << " at p = " << p << ": " << N / elapsed(t1, t2) / 1e6 << " M items/sec ("
+                  << speedup << "x), error bound " << sketch.ErrorBound() / N << " * N, { Precision, Recall } : { "
+                  << precision_recall.first << ", " << precision_recall.second << " }\n";
+
+        if (precision_recall.first >= TARGET_ACCURACY && precision_recall.second >= TARGET_ACCURACY && speedup > best_speedup) {
+            best_speedup = speedup;
+            best_p = p;
+        }
+    }
+    std::cout << name << " holds precision/recall >= " << TARGET_ACCURACY << " up to " << best_speedup
+              << "x (p = " << best_p << ")\n\n";
+}
+
+void bench_sampled(uint64_t N, double phi) {
+    uint64_t *numbers = generate_stream(N);
+
+    ExactCounter truth;
+    truth.AddBatch(numbers, N);
+    HeavyHitterList truth_hh = truth.HeavyHitters(phi);
+
+    bench_sampled_sketch<CountSketch>("Count Sketch", numbers, N, phi, truth_hh, 8, 2048);
+    bench_sampled_sketch<CountMinSketch>("Count-Min Sketch", numbers, N, phi, truth_hh, 8, 1024);
+    bench_sampled_sketch<MisraGries>("Misra-Gries", numbers, N, phi, truth_hh, 3000);
+
+    free(numbers);
+}
+
+// runs SketchConfig's choices on the Zipf stream and checks the accuracy target
+// held; configurations are ranked by cost measured on a prefix of the stream,
+// and the pick of the static cost model is shown against it
+void bench_calibrate(uint64_t N, double phi) {
+    uint64_t *numbers = generate_stream(N);
+    uint64_t sample = std::min<uint64_t>(N, CALIBRATE_SAMPLE);
+    high_resolution_clock::time_point t1, t2;
+    const char *kinds[] = {"Count-Min Sketch", "Count Sketch", "Misra-Gries"};
+
+    ExactCounter truth;
+    truth.AddBatch(numbers, N);
+    HeavyHitterList truth_hh = truth.HeavyHitters(phi);
+
+    for (int level : {2, 3}) {
+        size_t cache = SketchConfig::CacheBytes(level);
+        std::cout << "L" << level << " cache: " << cache << " bytes\n";
+        for (double epsilon : {phi / 2, phi / 5}) {
+            for (double skew : {0.0, EXP}) {
+                for (bool deletions : {false, true}) {
+                    SketchConfig modeled = SketchConfig::ForCache(level, phi, epsilon, DELTA, skew, deletions);
+                    double modeled_cost = modeled.cost;
+                    modeled.Measure(numbers, sample);
+                    SketchConfig config = SketchConfig::ForCache(level, phi, epsilon, DELTA, skew, deletions, numbers, sample);
+                    std::unique_ptr<Sketch> sketch = config.Build();
+
+                    t1 = high_resolution_clock::now();
+                    for (uint64_t i = 0; i < N; ++i) {
+                        sketch->Add(numbers[i]);
+                    }
+                    t2 = high_resolution_clock::now();
+
+                    // worst estimate error over the true heavy hitters
+                    uint64_t max_error = 0;
+                    for (const HeavyHitter& h : truth_hh) {
+                        uint64_t estimate = sketch->Estimate(h.key);
+                        max_error = std::max(max_error, estimate > h.estimate ? estimate - h.estimate : h.estimate - estimate);
+                    }
+                    auto precision_recall = compute_precision_recall(truth_hh, sketch->HeavyHitters(config.QueryPhi(phi)));
+
+                    std::cout << "  eps = " << epsilon << ", skew = " << skew << (deletions ? ", deletions" : "") << ": " << kinds[config.kind]
+                              << " t = " << config.t << ", k = " << config.k << ", " << config.counter_bits << "-bit counters, "
+                              << config.bytes << " bytes" << (config.bytes <= cache ? " (fits)" : " (exceeds cache)")
+                              << (config.meets_target ? "" : " [target not met]") << ", " << config.cost << " ns/update measured"
+                              << " (model picks " << kinds[modeled.kind] << " t = " << modeled.t << ", k = " << modeled.k
+                              << ": " << modeled_cost << " ns modeled, " << modeled.cost << " ns measured)\n"
+                              << "    " << N / elapsed(t1, t2) / 1e6 << " M items/sec, max error " << max_error
+                              << (max_error <= epsilon * N ? " <= " : " > ") << "eps*N = " << uint64_t(epsilon * N)
+                              << ", { Precision, Recall } : { " << precision_recall.first << ", " << precision_recall.second << " }\n";
+                }
+            }
+        }
+    }
+
+    free(numbers);
+}
+
+// row-partitioned AddBatch on one sketch against per-thread shards merged at the end
+template <class S>
+void bench_rowpar_sketch(const char *name, const uint64_t *numbers, uint64_t N, double phi,
+        const HeavyHitterList& truth_hh, uint64_t t, uint64_t k) {
+    high_resolution_clock::time_point t1, t2;
+
+    for (unsigned threads : {1, 2, 4, 8, 16, 32}) {
+        S rows(t, k);
+        t1 = high_resolution_clock::now();
+        for (uint64_t base = 0; base < N; base += ROW_BATCH) {
+            rows.AddBatch(numbers + base, std::min<uint64_t>(ROW_BATCH, N - base), threads);
+        }
+        t2 = high_resolution_clock::now();
+        double rows_time = elapsed(t1, t2);
+        auto rows_precision_recall = compute_precision_recall(truth_hh, rows.HeavyHitters(phi));
+
+        // shards are copies of one fresh sketch, so they share hash coefficients
+        S proto(t, k);
+        std::vector<S> shards(threads, proto);
+        std::vector<std::thread> workers;
+        t1 = high_resolution_clock::now();
+        for (unsigned w = 0; w < threads; w++) {
+            workers.emplace_back([&, w]() {
+                for (uint64_t i = N * w / threads; i < N * (w + 1) / threads; ++i) {
+                    shards[w].Add(numbers[i]);
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+        t2 = high_resolution_clock::now();
+        double shards_time = elapsed(t1, t2);
+        size_t shards_size = 0;
+        for (S& shard : shards) {
+            shards_size += shard.Size();
+        }
+        t1 = high_resolution_clock::now();
+        for (unsigned w = 1; w < threads; w++) {
+            shards[0].Merge(shards[w]);
+        }
+        t2 = high_resolution_clock::now();
+        double merge_time = elapsed(t1, t2);
+        auto shards_precision_recall = compute_precision_recall(truth_hh, shards[0].HeavyHitters(phi));
+
+        std::cout << name << " with " << threads << " threads:\n"
+                  << "  rows:   " << N / rows_time / 1e6 << " M items/sec, " << rows.Size() << " bytes, "
+                  << "{ Precision, Recall } : { " << rows_precision_recall.first << ", " << rows_precision_recall.second << " }\n"
+                  << "  shards: " << N / (shards_time + merge_time) / 1e6 << " M items/sec (merge " << merge_time << " secs), "
+                  << shards_size << " bytes, { Precision, Recall } : { "
+                  << shards_precision_recall.first << ", " << shards_precision_recall.second << " }\n";
+    }
+    std::cout << "\n";
+}
+
+void bench_rowpar(uint64_t N, double phi) {
+    uint64_t *numbers = generate_stream(N);
+
+    ExactCounter truth;
+    truth.AddBatch(numbers, N);
+    HeavyHitterList truth_hh = truth.HeavyHitters(phi);
+
+    bench_rowpar_sketch<CountSketch>("Count Sketch", numbers, N, phi, truth_hh, 8, 2048);
+    bench_rowpar_sketch<CountMinSketch>("Count-Min Sketch", numbers, N, phi, truth_hh, 8, 1024);
+
+    free(numbers);
+}
+
+// dumps one sketch per host (a contiguous slice of the stream each), then
+// reduces the directory with 1-8 threads
+template <class S, class Make>
+void bench_reduce_sketch(const char *name, const uint64_t *numbers, uint64_t N, double phi,
+        const HeavyHitterList& truth_hh, Make make) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / ("bench_reduce_" + std::to_string(getpid()));
+    std::filesystem::create_directory(dir);
+    std::string out = (dir / "merged").string();
+
+    std::vector<std::string> paths;
+    size_t bytes = 0;
+    for (uint64_t h = 0; h < HOSTS; h++) {
+        S host = make();
+        for (uint64_t i = N * h / HOSTS; i < N * (h + 1) / HOSTS; ++i) {
+            host.Add(numbers[i]);
+        }
+        paths.push_back((dir / ("host-" + std::to_string(h))).string());
+        if (!host.Save(paths.back().c_str())) {
+            std::cerr << "Could not write " << paths.back() << "\n";
+            exit(1);
+        }
+        bytes += std::filesystem::file_size(paths.back());
+    }
+
+    high_resolution_clock::time_point t1, t2;
+    for (unsigned threads : {1, 2, 4, 8}) {
+        t1 = high_resolution_clock::now();
+        std::unique_ptr<Sketch> merged = SketchFile::Reduce(paths, out.c_str(), threads);
+        t2 = high_resolution_clock::now();
+        if (!merged) {
+            std::cerr << "Could not reduce into " << out << "\n";
+            exit(1);
+        }
+        double reduce_time = elapsed(t1, t2);
+        auto precision_recall = compute_precision_recall(truth_hh, merged->HeavyHitters(phi));
+        std::cout << name << ", " << HOSTS << " x " << bytes / HOSTS << " bytes, " << threads << " threads: "
+                  << reduce_time << " secs, " << bytes / reduce_time / 1e9 << " GB/s, m = " << merged->StreamSize()
+                  << ", { Precision, Recall } : { " << precision_recall.first << ", " << precision_recall.second << " }\n";
+    }
+    std::cout << "\n";
+
+    std::filesystem::remove_all(dir);
+}
+
+void bench_reduce(uint64_t N, double phi) {
+    uint64_t *numbers = generate_stream(N);
+
+    ExactCounter truth;
+    truth.AddBatch(numbers, N);
+    HeavyHitterList truth_hh = truth.HeavyHitters(phi);
+
+    // 1 MB tables per host
+    bench_reduce_sketch<CountMinSketch>("Count-Min Sketch", numbers, N, phi, truth_hh,
+            []() { return CountMinSketch(8, 16384, HOST_SEED); });
+    bench_reduce_sketch<CountSketch>("Count Sketch", numbers, N, phi, truth_hh,
+            []() { return CountSketch(8, 16384, HOST_SEED); });
+    bench_reduce_sketch<MisraGries>("Misra-Gries", numbers, N, phi, truth_hh,
+            [phi]() { return MisraGries(2 / phi); });
+
+    free(numbers);
+}
+
+// ThresholdMonitor crossings against polling HeavyHitters(phi): ingest cost,
+// and whether the final watched set agrees with a last poll
+template <class S, class... Args>
+void bench_notify_sketch(const char *name, const uint64_t *numbers, uint64_t N, double phi,
+        const HeavyHitterList& truth_hh, Args... args) {
+    high_resolution_clock::time_point t1, t2;
+
+    S plain(args...);
+    t1 = high_resolution_clock::now();
+    for (uint64_t i = 0; i < N; ++i) {
+        plain.Add(numbers[i]);
+    }
+    t2 = high_resolution_clock::now();
+    double plain_time = elapsed(t1, t2);
+    std::cout << name << ": plain " << N / plain_time / 1e6 << " M items/sec\n";
+
+    for (uint64_t interval : POLL_INTERVALS) {
+        S polled(args...);
+        uint64_t polls = 0;
+        t1 = high_resolution_clock::now();
+        for (uint64_t i = 0; i < N; ++i) {
+            polled.Add(numbers[i]);
+            if ((i + 1) % interval == 0) {
+                polls += polled.HeavyHitters(phi).size();
+            }
+        }
+        t2 = high_resolution_clock::now();
+        double polled_time = elapsed(t1, t2);
+        std::cout << "  polled every " << interval << ": " << N / polled_time / 1e6 << " M items/sec, "
+                  << "mean alert latency ~" << interval / 2 << " updates (" << polls << " results)\n";
+    }
+
+    S inner(args...);
+    ThresholdMonitor monitor(inner);
+    uint64_t rises = 0, falls = 0;
+    monitor.Watch(phi, [&rises, &falls](const ThresholdCrossing& crossing) {
+        crossing.rising ? rises++ : falls++;
+    });
+    t1 = high_resolution_clock::now();
+    for (uint64_t i = 0; i < N; ++i) {
+        monitor.Add(numbers[i]);
+    }
+    t2 = high_resolution_clock::now();
+    double monitor_time = elapsed(t1, t2);
+
+    HeavyHitterList above = monitor.Above(0);
+    auto agreement = compute_precision_recall(monitor.HeavyHitters(phi), above);
+    auto precision_recall = compute_precision_recall(truth_hh, above);
+    std::cout << "  monitored: " << N / monitor_time / 1e6 << " M items/sec, latency 0 updates, "
+              << rises << " rises, " << falls << " falls, " << above.size() << " above\n"
+              << "    vs. final poll { Precision, Recall } : { " << agreement.first << ", " << agreement.second << " }, "
+              << "vs. truth { Precision, Recall } : { " << precision_recall.first << ", " << precision_recall.second << " }\n\n";
+}
+
+void bench_notify(uint64_t N, double phi) {
+    uint64_t *numbers = generate_stream(N);
+
+    ExactCounter truth;
+    truth.AddBatch(numbers, N);
+    HeavyHitterList truth_hh = truth.HeavyHitters(phi);
+
+    bench_notify_sketch<CountSketch>("Count Sketch", numbers, N, phi, truth_hh, 8, 2048);
+    bench_notify_sketch<CountMinSketch>("Count-Min Sketch", numbers, N, phi, truth_hh, 8, 1024);
+    bench_notify_sketch<MisraGries>("Misra-Gries", numbers, N, phi, truth_hh, 3000);
+
+    free(numbers);
+}
+
+// N updates spread uniformly over POOL_TENANTS tenants: Add, routed AddBatch,
+// Add with refunds mixed in, then Evict of every tenant and a refill of the freed slots
+void bench_pool_keys(const char *name, const uint64_t *keys, uint64_t N, double phi) {
+    uint64_t *tenants = (uint64_t *)malloc(N * sizeof(uint64_t));
+    std::mt19937_64 gen(N);
+    std::uniform_int_distribution<uint64_t> distrib_tenant(0, POOL_TENANTS - 1);
+    for (uint64_t i = 0; i < N; ++i) {
+        tenants[i] = distrib_tenant(gen);
+    }
+
+    // every REFUND_EVERY-th update deletes the one before it
+    uint64_t *refund_tenants = (uint64_t *)malloc(N * sizeof(uint64_t));
+    uint64_t *refund_keys = (uint64_t *)malloc(N * sizeof(uint64_t));
+    int64_t *deltas = (int64_t *)malloc(N * sizeof(int64_t));
+    for (uint64_t i = 0; i < N; ++i) {
+        bool refund = i % REFUND_EVERY == REFUND_EVERY - 1;
+        refund_tenants[i] = refund ? refund_tenants[i - 1] : tenants[i];
+        refund_keys[i] = refund ? refund_keys[i - 1] : keys[i];
+        deltas[i] = refund ? -1 : 1;
+    }
+
+    high_resolution_clock::time_point t1, t2;
+
+    SketchPool added(POOL_T, POOL_K);
+    t1 = high_resolution_clock::now();
+    for (uint64_t i = 0; i < N; ++i) {
+        added.Add(tenants[i], keys[i]);
+    }
+    t2 = high_resolution_clock::now();
+    double add_time = elapsed(t1, t2);
+
+    SketchPool batched(POOL_T, POOL_K);
+    t1 = high_resolution_clock::now();
+    batched.AddBatch(tenants, keys, nullptr, N);
+    t2 = high_resolution_clock::now();
+    double batch_time = elapsed(t1, t2);
+
+    SketchPool refunded(POOL_T, POOL_K);
+    t1 = high_resolution_clock::now();
+    for (uint64_t i = 0; i < N; ++i) {
+        refunded.Add(refund_tenants[i], refund_keys[i], deltas[i]);
+    }
+    t2 = high_resolution_clock::now();
+    double refund_time = elapsed(t1, t2);
+
+    t1 = high_resolution_clock::now();
+    for (uint64_t tenant = 0; tenant < POOL_TENANTS; ++tenant) {
+        added.Evict(tenant);
+    }
+    t2 = high_resolution_clock::now();
+    double evict_time = elapsed(t1, t2);
+
+    t1 = high_resolution_clock::now();
+    for (uint64_t i = 0; i < N; ++i) {
+        added.Add(tenants[i], keys[i]);
+    }
+    t2 = high_resolution_clock::now();
+    double refill_time = elapsed(t1, t2);
+
+    std::cout << name << ", " << POOL_TENANTS << " tenants, " << added.Size() / 1e6 << " MB: Add "
+              << N / add_time / 1e6 << " M updates/sec, AddBatch " << N / batch_time / 1e6
+              << " M updates/sec, with refunds " << N / refund_time / 1e6 << " M updates/sec, Evict "
+              << POOL_TENANTS / evict_time / 1e6 << " M tenants/sec, refill " << N / refill_time / 1e6
+              << " M updates/sec\n";
+
+    // tenant 0 after the refunds: deletions must not hide candidates
+    ExactCounter truth(1);
+    for (uint64_t i = 0; i < N; ++i) {
+        if (refund_tenants[i] == 0) {
+            truth.Add(refund_keys[i], deltas[i]);
+        }
+    }
+    HeavyHitterList truth_hh = truth.HeavyHitters(phi);
+    if (!truth_hh.empty()) {
+        auto precision_recall = compute_precision_recall(truth_hh, refunded.HeavyHitters(0, phi));
+        std::cout << "  tenant 0 with refunds, " << truth_hh.size() << " phi-heavy hitters, { Precision, Recall } : { "
+                  << precision_recall.first << ", " << precision_recall.second << " }\n";
+    }
+    std::cout << "\n";
+
+    free(deltas);
+    free(refund_keys);
+    free(refund_tenants);
+    free(tenants);
+}
+
+void bench_pool(uint64_t N, double phi) {
+    uint64_t *numbers = generate_stream(N);
+
+    uint64_t *uniform = (uint64_t *)malloc(N * sizeof(uint64_t));
+    std::mt19937_64 gen(N + 1);
+    std::uniform_int_distribution<uint64_t> distrib_key(0, (UNIVERSE) - 1);
+    for (uint64_t i = 0; i < N; ++i) {
+        uniform[i] = distrib_key(gen);
+    }
+
+    bench_pool_keys("Uniform keys", uniform, N, phi);
+    bench_pool_keys("Zipf keys", numbers, N, phi);
+
+    free(uniform);
+    free(numbers);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        std::cerr << "Usage: ./bench <mode> N phi\n"
+                  << "  modes: weighted, concurrent, strings, sampled, calibrate, rowpar, reduce, notify, pool\n";
+        exit(1);
+    }
+    const char *mode = argv[1];
+    uint64_t N = strtoull(argv[2], nullptr, 10);
+    double phi = atof(argv[3]);
+
+    if (strcmp(mode, "weighted") == 0) {
+        bench_weighted(N, phi);
+    } else if (strcmp(mode, "concurrent") == 0) {
+        bench_concurrent(N, phi);
+    } else if (strcmp(mode, "strings") == 0) {
+        bench_strings(N, phi);
+    } else if (strcmp(mode, "sampled") == 0) {
+        bench_sampled(N, phi);
+    } else if (strcmp(mode, "calibrate") == 0) {
+        bench_calibrate(N, phi);
+    } else if (strcmp(mode, "rowpar") == 0) {
+        bench_rowpar(N, phi);
+    } else if (strcmp(mode, "reduce") == 0) {
+        bench_reduce(N, phi);
+    } else if (strcmp(mode, "notify") == 0) {
+        bench_notify(N, phi);
+    } else if (strcmp(mode, "pool") == 0) {
+        bench_pool(N, phi);
+    } else {
+        std::cerr << "Unknown mode " << mode << "\n";
+        exit(1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef EVAL_H
+#define EVAL_H
+
+#include <chrono>
+#include <unordered_set>
+#include <utility>
+
+#include "sketching/sketch.hpp"
+
+// shared helpers for the test and bench drivers
+
+inline double elapsed(std::chrono::high_resolution_clock::time_point t1,
+            std::chrono::high_resolution_clock::time_point t2) {
+    return (std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1)).count();
+}
+
+inline std::pair<double, double> compute_precision_recall(
+    const HeavyHitterList& truth_hh,
+    const HeavyHitterList& sketch_hh
+) {
+    // hash-join on key
+    std::unordered_set<uint64_t> truth_keys;
+    truth_keys.reserve(truth_hh.size());
+    for (const HeavyHitter& h : truth_hh) {
+        truth_keys.insert(h.key);
+    }
+
+    // true positive, false positive, false negative
+    float tp = 0, fp = 0, fn = 0;
+
+    for (const HeavyHitter& h : sketch_hh) {
+        if (truth_keys.count(h.key)) {
+            tp++;
+        } else {
+            fp++;
+        }
+    }
+    fn = truth_hh.size() - tp;
+
+    double precision = tp + fp > 0 ? tp / (tp + fp) : 0.0;
+    double recall = tp + fn > 0 ? tp / (tp + fn) : 0.0;
+
+    return {precision, recall};
+}
+
+#endif
@@ -0,0 +1,80 @@
+// Offline reducer for dumped sketches, e.g. one per host per minute:
+//   ./reduce <dir> <out> [k] [threads]
+// Merges every sketch in dir (all Count-Min, all Count Sketch or all
+// Misra-Gries, built with the same dimensions and seed) into out, then prints
+// the k (default 100) candidates with the highest merged estimates. Files that
+// are not dumped sketches, or do not match the first one, are named on stderr
+// and skipped; the exit status is then 2, and 1 if nothing could be merged or
+// out could not be written.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+
+#include "sketching/sketch.hpp"
+#include "eval.hpp"
+
+using namespace std::chrono;
+
+#define DEFAULT_TOP_K 100
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: ./reduce <dir> <out> [k] [threads]\n";
+        exit(1);
+    }
+    const char *dir = argv[1];
+    const char *out = argv[2];
+    size_t top_k = argc > 3 ? atoi(argv[3]) : DEFAULT_TOP_K;
+    unsigned threads = argc > 4 ? atoi(argv[4]) : std::thread::hardware_concurrency();
+
+    // sorted, so the same directory always reduces in the same order
+    std::vector<std::string> paths;
+    size_t bytes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        if (entry.is_regular_file() && entry.path().extension() != ".tmp") {
+            paths.push_back(entry.path().string());
+            bytes += entry.file_size();
+        }
+    }
+    if (paths.empty()) {
+        std::cerr << "No sketches in " << dir << "\n";
+        exit(1);
+    }
+    std::sort(paths.begin(), paths.end());
+
+    high_resolution_clock::time_point t1, t2;
+    t1 = high_resolution_clock::now();
+    std::vector<std::string> rejected;
+    std::unique_ptr<Sketch> merged = SketchFile::Reduce(paths, out, threads, &rejected);
+    t2 = high_resolution_clock::now();
+    double reduce_time = elapsed(t1, t2);
+
+    for (const std::string& reason : rejected) {
+        std::cerr << "Skipped " << reason << "\n";
+    }
+    if (rejected.size() == paths.size()) {
+        std::cerr << "No usable sketches in " << dir << "\n";
+        exit(1);
+    }
+    if (!merged) {
+        std::cerr << "Could not write " << out << "\n";
+        exit(1);
+    }
+
+    std::cout << "Merged " << paths.size() - rejected.size() << " sketches (" << bytes / 1e6 << " MB) in " << reduce_time
+              << " secs, " << bytes / reduce_time / 1e9 << " GB/s\n"
+              << "Stream size: " << merged->StreamSize() << ", error bound: " << merged->ErrorBound() << "\n\n";
+
+    std::cout << "rank\tkey\testimate\tshare\n";
+    HeavyHitterList top = merged->TopK(top_k);
+    for (size_t i = 0; i < top.size(); i++) {
+        std::cout << i + 1 << "\t" << top[i].key << "\t" << top[i].estimate << "\t"
+                  << double(top[i].estimate) / merged->StreamSize() << "\n";
+    }
+
+    return rejected.empty() ? 0 : 2;
+}
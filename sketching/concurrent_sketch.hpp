@@ -0,0 +1,115 @@
+#ifndef CONCURRENT_SKETCH_H
+#define CONCURRENT_SKETCH_H
+
+#include <atomic>
+#include <utility>
+#include "sketch.hpp"
+
+// query-while-ingesting wrapper around a copyable sketch S (CountSketch,
+// CountMinSketch, MisraGries).
+//
+// A single writer thread calls Add on a private live sketch. Every
+// publish_interval updates (or sooner, when a reader asks) it copies the live
+// sketch into the back one of two snapshot buffers and flips the front index.
+// Any number of reader threads query the front snapshot, so every answer comes
+// from one consistent point of the stream.
+//
+// The writer never blocks: a buffer is only overwritten once no reader has it
+// pinned, and a publish that would have to wait is retried on the next update.
+template <class S>
+class ConcurrentSketch {
+    public:
+        // publish_interval = updates between snapshots, args = S's constructor arguments
+        template <class... Args>
+        ConcurrentSketch(uint64_t publish_interval, Args&&... args)
+                : live(std::forward<Args>(args)...), snapshots{live, live}, front(0),
+                  readers{{0}, {0}}, requested(false), publish_interval(publish_interval), since(0) {}
+
+        // writer thread only
+
+        void Add(uint64_t x) {
+            live.Add(x);
+            MaybePublish();
+        }
+        void Add(uint64_t x, int64_t delta) {
+            live.Add(x, delta);
+            MaybePublish();
+        }
+        // publishes now (returns false if both buffers are pinned by readers)
+        bool Publish() {
+            int back = 1 - front.load();
+            if (readers[back].load() != 0) {
+                return false;
+            }
+            snapshots[back] = live;
+            front.store(back);
+            since = 0;
+            requested.store(false, std::memory_order_relaxed);
+            return true;
+        }
+        // the writer's own sketch, e.g. for exact queries after ingestion stops
+        S& Live() { return live; }
+
+        // any thread
+
+        uint64_t Estimate(uint64_t x) {
+            return Read([x](S& s) { return s.Estimate(x); });
+        }
+        HeavyHitterList HeavyHitters(double phi) {
+            return Read([phi](S& s) { return s.HeavyHitters(phi); });
+        }
+        std::vector<HeavyHitterList> HeavyHitters(const std::vector<double>& phis) {
+            return Read([&phis](S& s) { return s.HeavyHitters(phis); });
+        }
+        HeavyHitterList TopK(size_t k) {
+            return Read([k](S& s) { return s.TopK(k); });
+        }
+        // stream size as of the current snapshot
+        uint64_t StreamSize() {
+            return Read([](S& s) { return s.StreamSize(); });
+        }
+        // asks the writer to publish at its next update instead of waiting out the interval
+        void RequestSnapshot() {
+            requested.store(true, std::memory_order_relaxed);
+        }
+    private:
+        S live;
+        S snapshots[2];
+        // snapshot readers should use
+        std::atomic<int> front;
+        // readers pinning each snapshot
+        std::atomic<uint64_t> readers[2];
+        std::atomic<bool> requested;
+
+        uint64_t publish_interval;
+        // writer's updates since the last publish
+        uint64_t since;
+
+        inline void MaybePublish() {
+            if (++since >= publish_interval || requested.load(std::memory_order_relaxed)) {
+                Publish();
+            }
+        }
+
+        // pins the front snapshot, runs query on it, then unpins it. The pin is
+        // re-validated after incrementing so a reader never uses a buffer the
+        // writer may have started overwriting (seq_cst pairs the reader's
+        // increment-then-load with the writer's store-then-load in Publish)
+        template <class F>
+        auto Read(F query) {
+            int f;
+            while (true) {
+                f = front.load();
+                readers[f].fetch_add(1);
+                if (front.load() == f) {
+                    break;
+                }
+                readers[f].fetch_sub(1);
+            }
+            auto result = query(snapshots[f]);
+            readers[f].fetch_sub(1, std::memory_order_release);
+            return result;
+        }
+};
+
+#endif
@@ -1,17 +1,19 @@
 #include "sketch.hpp"
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
 
-CountSketch::CountSketch(uint64_t t, uint64_t k) : m(0), t(t), k(k) {
+CountSketch::CountSketch(uint64_t t, uint64_t k, uint64_t seed) : t(t), k(k) {
     // k must be power of 2 for efficient hashing techniques
     assert((k & (k - 1)) == 0 && k > 0);
 
-    this->table = (int64_t*) malloc(t * k * sizeof(int64_t));
+    this->table = (int64_t*) AllocTable(t * k);
     this->hash_coeffs = (uint64_t*) malloc(t * 4 * sizeof(uint64_t));
 
     // coefficients for t pairwise independent hash functions
 
-    std::random_device rd;
-    std::mt19937_64 gen(rd());
+    std::mt19937_64 gen(seed);
     std::uniform_int_distribution<uint64_t> distrib_a(1ULL, LARGE_PRIME - 1ULL); // 0 < a < p
     std::uniform_int_distribution<uint64_t> distrib_b(0ULL, LARGE_PRIME - 1ULL); // 0 ≤ b < p
 
@@ -35,6 +37,17 @@ CountSketch::CountSketch(uint64_t t, uint64_t k) : m(0), t(t), k(k) {
     // }
 }
 
+CountSketch::CountSketch(const SketchFile& file) : t(file.t), k(file.k) {
+    assert(file.kind == SketchConfig::COUNT_SKETCH);
+
+    this->table = (int64_t*) AllocTable(t * k);
+    this->hash_coeffs = (uint64_t*) malloc(t * 4 * sizeof(uint64_t));
+    memcpy(this->table, file.table, t * k * sizeof(int64_t));
+    memcpy(this->hash_coeffs, file.hash_coeffs, t * 4 * sizeof(uint64_t));
+    this->m = file.m;
+    this->seen.insert(file.candidates, file.candidates + file.c);
+}
+
 CountSketch::~CountSketch() {
     free(this->table);
     this->table = nullptr;
@@ -43,6 +56,35 @@ CountSketch::~CountSketch() {
     this->hash_coeffs = nullptr;
 }
 
+CountSketch::CountSketch(const CountSketch& other) : Sketch(other), t(other.t), k(other.k), seen(other.seen) {
+    this->table = (int64_t*) AllocTable(t * k);
+    this->hash_coeffs = (uint64_t*) malloc(t * 4 * sizeof(uint64_t));
+    memcpy(this->table, other.table, t * k * sizeof(int64_t));
+    memcpy(this->hash_coeffs, other.hash_coeffs, t * 4 * sizeof(uint64_t));
+}
+
+// reuses the allocations when the dimensions match
+CountSketch& CountSketch::operator=(const CountSketch& other) {
+    if (this == &other) {
+        return *this;
+    }
+    if (this->t * this->k != other.t * other.k) {
+        free(this->table);
+        this->table = (int64_t*) AllocTable(other.t * other.k);
+    }
+    if (this->t != other.t) {
+        this->hash_coeffs = (uint64_t*) realloc(this->hash_coeffs, other.t * 4 * sizeof(uint64_t));
+    }
+    this->m = other.m;
+    this->t = other.t;
+    this->k = other.k;
+    memcpy(this->table, other.table, t * k * sizeof(int64_t));
+    memcpy(this->hash_coeffs, other.hash_coeffs, t * 4 * sizeof(uint64_t));
+    this->seen = other.seen;
+
+    return *this;
+}
+
 inline uint64_t CountSketch::BucketHash(uint64_t x, uint64_t row) {
     uint64_t a1 = this->hash_coeffs[row * 4];
     uint64_t b1 = this->hash_coeffs[row * 4 + 1];
@@ -92,20 +134,107 @@ inline int8_t CountSketch::UpdateHash(uint64_t x, uint64_t row) {
 }
 
 void CountSketch::Add(uint64_t x) {
+    CountSketch::Add(x, 1);
+}
+
+// O(t) regardless of the weight
+void CountSketch::Add(uint64_t x, int64_t delta) {
     for (uint64_t row = 0; row < this->t; row++) {
         uint64_t bucket = BucketHash(x, row);
         int8_t update = UpdateHash(x, row);
-        table[row * this->k + bucket] += update;
+        table[row * this->k + bucket] += update * delta;
     }
 
-    this->m++;
+    this->m += delta;
 
     // working heavy hitter candidates
-    if (this->Estimate(x) >= this->m * MIN_PHI) {
-        this->seen.insert(x);
+    if (delta > 0) {
+        if (this->Estimate(x) >= this->m * MIN_PHI) {
+            this->seen.insert(x);
+        }
+    } else if (this->seen.count(x) && this->Estimate(x) < this->m * MIN_PHI) {
+        this->seen.erase(x);
     }
 }
 
+// unit updates in two passes: rows split among the threads, then candidates checked once per key
+void CountSketch::AddBatch(const uint64_t *keys, uint64_t n, unsigned threads) {
+    threads = std::max(1U, threads);
+    unsigned owners = std::min<uint64_t>(threads, this->t);
+    std::vector<std::thread> workers;
+
+    // 1. worker w owns rows [t*w/owners, t*(w+1)/owners) and applies every key to them
+    for (unsigned w = 0; w < owners; w++) {
+        workers.emplace_back([this, keys, n, owners, w]() {
+            uint64_t first = this->t * w / owners;
+            uint64_t last = this->t * (w + 1) / owners;
+            for (uint64_t i = 0; i < n; i++) {
+                for (uint64_t row = first; row < last; row++) {
+                    table[row * this->k + BucketHash(keys[i], row)] += UpdateHash(keys[i], row);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    workers.clear();
+
+    this->m += n;
+
+    // 2. working heavy hitter candidates, checked against the end-of-batch m by
+    //    every thread over a slice of the keys while the table is read-only
+    uint64_t threshold = this->m * MIN_PHI;
+    uint64_t slice = (n + threads - 1) / threads;
+    std::vector<std::vector<uint64_t>> found(threads);
+    for (unsigned w = 0; w < threads; w++) {
+        workers.emplace_back([this, keys, n, slice, threshold, &found, w]() {
+            uint64_t end = std::min(n, (w + 1) * slice);
+            for (uint64_t i = w * slice; i < end; i++) {
+                if (!this->seen.count(keys[i]) && this->Estimate(keys[i]) >= threshold) {
+                    found[w].push_back(keys[i]);
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+
+    for (const auto& keys_found : found) {
+        this->seen.insert(keys_found.begin(), keys_found.end());
+    }
+}
+
+void CountSketch::Merge(const CountSketch& other) {
+    assert(this->t == other.t && this->k == other.k);
+    MergeCounters(other.table, other.hash_coeffs, other.m, nullptr, 0);
+    this->seen.insert(other.seen.begin(), other.seen.end());
+}
+
+void CountSketch::Merge(const SketchFile& file) {
+    assert(file.kind == SketchConfig::COUNT_SKETCH);
+    assert(this->t == file.t && this->k == file.k);
+    MergeCounters((const int64_t*) file.table, file.hash_coeffs, file.m, file.candidates, file.c);
+}
+
+// sums the tables (a single pass the compiler vectorizes, so merging runs at
+// memory bandwidth) and adds other's candidates
+void CountSketch::MergeCounters(const int64_t *other_table, const uint64_t *other_coeffs, uint64_t other_m,
+                                const uint64_t *candidates, uint64_t c) {
+    assert(memcmp(this->hash_coeffs, other_coeffs, t * 4 * sizeof(uint64_t)) == 0);
+
+    int64_t *__restrict dst = this->table;
+    const int64_t *__restrict src = other_table;
+    for (uint64_t i = 0; i < t * k; i++) {
+        dst[i] += src[i];
+    }
+    this->m += other_m;
+    this->seen.insert(candidates, candidates + c);
+}
+
+bool CountSketch::Save(const char *path) {
+    std::vector<uint64_t> candidates(this->seen.begin(), this->seen.end());
+    return SketchFile::Write(path, SketchConfig::COUNT_SKETCH, t, k, this->m, candidates.size(),
+                             {{table, t * k}, {hash_coeffs, t * 4}, {candidates.data(), candidates.size()}});
+}
+
 uint64_t CountSketch::Estimate(uint64_t x) {
     std::vector<int64_t> counters = std::vector<int64_t>(t);
 
@@ -121,20 +250,34 @@ uint64_t CountSketch::Estimate(uint64_t x) {
     return std::max(counters[t / 2], int64_t(0)); // no negative counts
 }
 
-std::multimap<uint64_t, uint64_t, std::greater<uint64_t>> CountSketch::HeavyHitters(double phi) {
-    uint64_t threshold = phi * this->m;
-    
-    std::multimap<uint64_t, uint64_t, std::greater<uint64_t>> hh;
+bool CountSketch::IsCandidate(uint64_t x) {
+    return this->seen.count(x);
+}
+
+void CountSketch::Candidates(HeavyHitterList& out, uint64_t threshold) {
     for (uint64_t x : seen) {
         uint64_t count = Estimate(x);
         if (count >= threshold) {
-            hh.insert({count, x});
+            out.push_back({x, count});
         }
     }
-
-    return hh;
 }
 
 size_t CountSketch::Size() {
     return sizeof(*this) + (3 + (this->t * this->k) + (this->k * 4) + this->seen.size()) * sizeof(uint64_t);
-}
\ No newline at end of file
+}
+
+// eps*||f||_2 with k = 3/eps^2, where F2 = ||f||_2^2 is estimated as the
+// median over rows of the sum of squared counters
+double CountSketch::ErrorBound() {
+    std::vector<double> f2(t);
+    for (uint64_t row = 0; row < t; row++) {
+        for (uint64_t bucket = 0; bucket < this->k; bucket++) {
+            double count = table[row * this->k + bucket];
+            f2[row] += count * count;
+        }
+    }
+
+    std::nth_element(f2.begin(), f2.begin() + t / 2, f2.end());
+    return std::sqrt(3.0 * f2[t / 2] / this->k);
+}
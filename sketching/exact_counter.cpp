@@ -0,0 +1,278 @@
+#include "sketch.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// 2^8 radix partitions, picked by the high bits of the key hash
+const unsigned PARTITION_BITS = 8;
+const uint64_t PARTITIONS = 1ULL << PARTITION_BITS;
+// initial slots per partition (power of 2)
+const uint64_t INITIAL_CAPACITY = 1024;
+// batches are partitioned CHUNK keys at a time to bound the scatter buffer
+const uint64_t CHUNK = 1ULL << 22;
+// marks an empty slot
+const uint64_t EMPTY_KEY = UINT64_MAX;
+
+static uint64_t *AllocSlots(uint64_t capacity) {
+    uint64_t *slots = (uint64_t*) malloc(capacity * 2 * sizeof(uint64_t));
+    assert(slots);
+    // all-ones bytes = EMPTY_KEY in every key (and count) slot
+    memset(slots, 0xFF, capacity * 2 * sizeof(uint64_t));
+    return slots;
+}
+
+ExactCounter::ExactCounter(unsigned threads) : threads(threads), empty_key_count(0) {
+    if (this->threads == 0) {
+        this->threads = std::max(1U, std::thread::hardware_concurrency());
+    }
+
+    this->partitions = (Partition*) malloc(PARTITIONS * sizeof(Partition));
+    for (uint64_t p = 0; p < PARTITIONS; p++) {
+        partitions[p].slots = AllocSlots(INITIAL_CAPACITY);
+        partitions[p].capacity = INITIAL_CAPACITY;
+        partitions[p].size = 0;
+    }
+}
+
+ExactCounter::~ExactCounter() {
+    for (uint64_t p = 0; p < PARTITIONS; p++) {
+        free(partitions[p].slots);
+    }
+    free(this->partitions);
+    this->partitions = nullptr;
+}
+
+// doubles the partition table and reinserts its keys
+void ExactCounter::Grow(Partition& p) {
+    uint64_t *old = p.slots;
+    uint64_t old_capacity = p.capacity;
+
+    p.capacity *= 2;
+    p.slots = AllocSlots(p.capacity);
+    uint64_t mask = p.capacity - 1;
+
+    for (uint64_t i = 0; i < old_capacity; i++) {
+        uint64_t key = old[2 * i];
+        if (key == EMPTY_KEY) {
+            continue;
+        }
+        uint64_t j = Mix(key) & mask;
+        while (p.slots[2 * j] != EMPTY_KEY) {
+            j = (j + 1) & mask;
+        }
+        p.slots[2 * j] = key;
+        p.slots[2 * j + 1] = old[2 * i + 1];
+    }
+
+    free(old);
+}
+
+// linear probing; h = Mix(x)
+inline void ExactCounter::Insert(Partition& p, uint64_t x, uint64_t h, int64_t delta) {
+    if (x == EMPTY_KEY) {
+        this->empty_key_count += delta;
+        return;
+    }
+
+    uint64_t mask = p.capacity - 1;
+    uint64_t i = h & mask;
+    while (true) {
+        uint64_t key = p.slots[2 * i];
+        if (key == x) {
+            p.slots[2 * i + 1] += delta;
+            return;
+        }
+        if (key == EMPTY_KEY) {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+
+    // keep load factor ≤ 0.7
+    if ((p.size + 1) * 10 > p.capacity * 7) {
+        Grow(p);
+        mask = p.capacity - 1;
+        i = h & mask;
+        while (p.slots[2 * i] != EMPTY_KEY) {
+            i = (i + 1) & mask;
+        }
+    }
+    p.slots[2 * i] = x;
+    p.slots[2 * i + 1] = delta;
+    p.size++;
+}
+
+void ExactCounter::Add(uint64_t x) {
+    ExactCounter::Add(x, 1);
+}
+
+void ExactCounter::Add(uint64_t x, int64_t delta) {
+    uint64_t h = Mix(x);
+    Insert(partitions[h >> (64 - PARTITION_BITS)], x, h, delta);
+    this->m += delta;
+}
+
+// counts the scattered partitions owned by this worker (p ≡ worker mod threads)
+void ExactCounter::CountPartitions(const uint64_t *keys, const uint64_t *offsets, unsigned worker) {
+    for (uint64_t p = worker; p < PARTITIONS; p += this->threads) {
+        Partition& part = partitions[p];
+        for (uint64_t i = offsets[p]; i < offsets[p + 1]; i++) {
+            Insert(part, keys[i], Mix(keys[i]), 1);
+        }
+    }
+}
+
+void ExactCounter::AddBatch(const uint64_t *keys, uint64_t n) {
+    if (this->threads == 1) {
+        for (uint64_t i = 0; i < n; i++) {
+            Add(keys[i]);
+        }
+        return;
+    }
+
+    unsigned T = this->threads;
+    // scatter buffer for radix partitioning one chunk
+    std::vector<uint64_t> buffer(std::min(n, CHUNK));
+
+    // histogram[w * PARTITIONS + p] = keys of partition p in worker w's slice
+    std::vector<uint64_t> histogram(T * PARTITIONS);
+    std::vector<uint64_t> offsets(PARTITIONS + 1);
+    std::vector<std::thread> workers(T);
+
+    for (uint64_t base = 0; base < n; base += CHUNK) {
+        const uint64_t *chunk = keys + base;
+        uint64_t c = std::min(CHUNK, n - base);
+        uint64_t slice = (c + T - 1) / T;
+
+        // 1. per-worker histograms over contiguous slices
+        std::fill(histogram.begin(), histogram.end(), 0);
+        for (unsigned w = 0; w < T; w++) {
+            workers[w] = std::thread([&, w]() {
+                uint64_t *hist = &histogram[w * PARTITIONS];
+                uint64_t end = std::min(c, (w + 1) * slice);
+                for (uint64_t i = w * slice; i < end; i++) {
+                    hist[Mix(chunk[i]) >> (64 - PARTITION_BITS)]++;
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+
+        // 2. exclusive prefix sums, partition-major so each partition is contiguous
+        uint64_t running = 0;
+        for (uint64_t p = 0; p < PARTITIONS; p++) {
+            offsets[p] = running;
+            for (unsigned w = 0; w < T; w++) {
+                uint64_t count = histogram[w * PARTITIONS + p];
+                histogram[w * PARTITIONS + p] = running;
+                running += count;
+            }
+        }
+        offsets[PARTITIONS] = running;
+
+        // 3. scatter each slice into its partitions' ranges
+        for (unsigned w = 0; w < T; w++) {
+            workers[w] = std::thread([&, w]() {
+                uint64_t *cursor = &histogram[w * PARTITIONS];
+                uint64_t end = std::min(c, (w + 1) * slice);
+                for (uint64_t i = w * slice; i < end; i++) {
+                    buffer[cursor[Mix(chunk[i]) >> (64 - PARTITION_BITS)]++] = chunk[i];
+                }
+            });
+        }
+        for (auto& worker : workers) worker.join();
+
+        // 4. count, each worker owning a disjoint set of partitions
+        // (the empty key hashes to a single partition, so its side counter has a single writer)
+        for (unsigned w = 0; w < T; w++) {
+            workers[w] = std::thread([&, w]() {
+                CountPartitions(buffer.data(), offsets.data(), w);
+            });
+        }
+        for (auto& worker : workers) worker.join();
+
+        this->m += c;
+    }
+}
+
+uint64_t ExactCounter::Estimate(uint64_t x) {
+    if (x == EMPTY_KEY) {
+        return this->empty_key_count;
+    }
+
+    uint64_t h = Mix(x);
+    Partition& p = partitions[h >> (64 - PARTITION_BITS)];
+    uint64_t mask = p.capacity - 1;
+    for (uint64_t i = h & mask; p.slots[2 * i] != EMPTY_KEY; i = (i + 1) & mask) {
+        if (p.slots[2 * i] == x) {
+            return p.slots[2 * i + 1];
+        }
+    }
+    return 0;
+}
+
+bool ExactCounter::IsCandidate(uint64_t x) {
+    return Estimate(x) > 0;
+}
+
+void ExactCounter::Candidates(HeavyHitterList& out, uint64_t threshold) {
+    uint64_t total = this->empty_key_count;
+
+    for (uint64_t p = 0; p < PARTITIONS; p++) {
+        const Partition& part = partitions[p];
+        for (uint64_t i = 0; i < part.capacity; i++) {
+            if (part.slots[2 * i] == EMPTY_KEY) {
+                continue;
+            }
+            // (items deleted back to 0 are not candidates)
+            if (part.slots[2 * i + 1] >= threshold && part.slots[2 * i + 1] > 0) {
+                out.push_back({part.slots[2 * i], part.slots[2 * i + 1]});
+            }
+            total += part.slots[2 * i + 1];
+        }
+    }
+    if (this->empty_key_count > 0 && this->empty_key_count >= threshold) {
+        out.push_back({EMPTY_KEY, this->empty_key_count});
+    }
+    // every item is counted exactly once
+    assert(total == this->m);
+}
+
+uint64_t ExactCounter::Distinct() {
+    uint64_t distinct = this->empty_key_count > 0;
+    for (uint64_t p = 0; p < PARTITIONS; p++) {
+        distinct += partitions[p].size;
+    }
+    return distinct;
+}
+
+size_t ExactCounter::Size() {
+    size_t slots = 0;
+    for (uint64_t p = 0; p < PARTITIONS; p++) {
+        slots += partitions[p].capacity * 2;
+    }
+    return sizeof(*this) + PARTITIONS * sizeof(Partition) + slots * sizeof(uint64_t);
+}
+
+double ExactCounter::ErrorBound() {
+    return 0;
+}
+
+HeavyHitterList ExactCounter::SortedHeavyHitters(uint64_t *keys, uint64_t n, double phi) {
+    uint64_t threshold = PhiThreshold(phi, n);
+    std::sort(keys, keys + n);
+
+    HeavyHitterList hh;
+    for (uint64_t i = 0; i < n; ) {
+        uint64_t j = i + 1;
+        while (j < n && keys[j] == keys[i]) {
+            j++;
+        }
+        if (j - i >= threshold) {
+            hh.push_back({keys[i], j - i});
+        }
+        i = j;
+    }
+    std::sort(hh.begin(), hh.end(), ByEstimate);
+
+    return hh;
+}
@@ -1,9 +1,73 @@
 #include "sketch.hpp"
+#include <algorithm>
 
-MisraGries::MisraGries(uint64_t k) : m(0), k(k) {
+MisraGries::MisraGries(uint64_t k) : k(k), inserted(0) {
     counters.reserve(k);
 }
 
+MisraGries::MisraGries(const SketchFile& file) : k(file.k), inserted(file.inserted) {
+    assert(file.kind == SketchConfig::MISRA_GRIES);
+
+    counters.reserve(k);
+    this->m = file.m;
+    for (uint64_t i = 0; i < file.c; i++) {
+        this->counters[file.candidates[2 * i]] = file.candidates[2 * i + 1];
+    }
+}
+
+bool MisraGries::Save(const char *path) {
+    std::vector<uint64_t> pairs;
+    pairs.reserve(this->counters.size() * 2);
+    for (const auto& [key, count] : this->counters) {
+        pairs.push_back(key);
+        pairs.push_back(count);
+    }
+    return SketchFile::Write(path, SketchConfig::MISRA_GRIES, 1, this->k, this->m, this->counters.size(),
+                             {{pairs.data(), pairs.size()}}, this->inserted);
+}
+
+void MisraGries::Merge(const MisraGries& other) {
+    assert(this->k == other.k);
+    for (const auto& [key, count] : other.counters) {
+        this->counters[key] += count;
+    }
+    MergeCounters(nullptr, 0, other.m, other.inserted);
+}
+
+void MisraGries::Merge(const SketchFile& file) {
+    assert(file.kind == SketchConfig::MISRA_GRIES && this->k == file.k);
+    MergeCounters(file.candidates, file.c, file.m, file.inserted);
+}
+
+// adds n {key, count} pairs, then subtracts the k-th largest count from every
+// counter and drops the ones left at 0 (the mergeable summaries reduction)
+void MisraGries::MergeCounters(const uint64_t *pairs, uint64_t n, uint64_t other_m, uint64_t other_inserted) {
+    for (uint64_t i = 0; i < n; i++) {
+        this->counters[pairs[2 * i]] += pairs[2 * i + 1];
+    }
+    this->m += other_m;
+    this->inserted += other_inserted;
+
+    if (this->counters.size() < this->k) {
+        return;
+    }
+    std::vector<uint64_t> counts;
+    counts.reserve(this->counters.size());
+    for (const auto& [key, count] : this->counters) {
+        counts.push_back(count);
+    }
+    std::nth_element(counts.begin(), counts.begin() + (this->k - 1), counts.end(), std::greater<uint64_t>());
+    uint64_t kth = counts[this->k - 1];
+    for (auto it = this->counters.begin(); it != this->counters.end(); ) {
+        if (it->second <= kth) {
+            it = this->counters.erase(it);
+        } else {
+            it->second -= kth;
+            ++it;
+        }
+    }
+}
+
 void MisraGries::Add(uint64_t x) {
     if (this->counters.count(x)) {
         this->counters[x]++;
@@ -20,6 +84,58 @@ void MisraGries::Add(uint64_t x) {
     }
 
     this->m++;
+    this->inserted++;
+}
+
+// weighted decrement: an untracked item with weight w decrements every counter
+// by min(w, smallest counter) in one pass, and keeps whatever weight is left over.
+// deletions only reach tracked items; an untracked item's deleted weight was
+// already absorbed by earlier decrements, so only m changes (ErrorBound stays
+// based on the inserted weight, since the decrements are not undone)
+void MisraGries::Add(uint64_t x, int64_t delta) {
+    // a zero weight must not take a counter
+    if (delta == 0) {
+        return;
+    }
+    this->m += delta;
+
+    auto found = this->counters.find(x);
+    if (delta < 0) {
+        if (found != this->counters.end()) {
+            if (found->second <= uint64_t(-delta)) {
+                this->counters.erase(found);
+            } else {
+                found->second += delta;
+            }
+        }
+        return;
+    }
+
+    uint64_t w = delta;
+    this->inserted += w;
+    if (found != this->counters.end()) {
+        found->second += w;
+        return;
+    }
+    if (this->counters.size() < this->k - 1) {
+        this->counters[x] = w;
+        return;
+    }
+
+    uint64_t min = w;
+    for (const auto& [key, count] : this->counters) {
+        min = std::min(min, count);
+    }
+    for (auto it = this->counters.begin(); it != this->counters.end(); ) {
+        if ((it->second -= min) == 0) {
+            it = this->counters.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (w > min) {
+        this->counters[x] = w - min;
+    }
 }
 
 uint64_t MisraGries::Estimate(uint64_t x) {
@@ -27,19 +143,23 @@ uint64_t MisraGries::Estimate(uint64_t x) {
     return it != this->counters.end() ? it->second : 0;
 }
 
-std::multimap<uint64_t, uint64_t, std::greater<uint64_t>> MisraGries::HeavyHitters(double phi) {
-    uint64_t threshold = phi * this->m;
+bool MisraGries::IsCandidate(uint64_t x) {
+    return this->counters.count(x);
+}
 
-    std::multimap<uint64_t, uint64_t, std::greater<uint64_t>> hh;
+void MisraGries::Candidates(HeavyHitterList& out, uint64_t threshold) {
     for (const auto& [key, count] : this->counters) {
         if (count >= threshold) {
-            hh.insert({count, key});
+            out.push_back({key, count});
         }
     }
-
-    return hh;
 }
 
 size_t MisraGries::Size() {
     return sizeof(*this) + (2 + (this->counters.size() * 2)) * sizeof(uint64_t);
 }
+
+// every counter undercounts by at most inserted/k (m/k without deletions)
+double MisraGries::ErrorBound() {
+    return double(this->inserted) / this->k;
+}
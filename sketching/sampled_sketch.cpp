@@ -0,0 +1,75 @@
+#include "sketch.hpp"
+#include <cmath>
+
+// standard deviations of sampling error folded into ErrorBound
+const double SAMPLING_Z = 3.0;
+
+SampledSketch::SampledSketch(Sketch& inner, double p, uint64_t seed)
+        : inner(inner), p(p), weight_squares(0), gen(seed), distrib_u(0.0, 1.0) {
+    assert(p > 0 && p <= 1);
+    this->skip = NextSkip();
+}
+
+// inverse transform: floor(ln(u) / ln(1 - p)) for u uniform in (0, 1]
+inline uint64_t SampledSketch::NextSkip() {
+    if (this->p >= 1) {
+        return 0;
+    }
+    double u = 1.0 - this->distrib_u(this->gen);
+    return std::floor(std::log(u) / std::log1p(-this->p));
+}
+
+void SampledSketch::Add(uint64_t x) {
+    this->m++;
+    this->weight_squares++;
+
+    if (this->skip > 0) {
+        this->skip--;
+        return;
+    }
+    this->inner.Add(x);
+    this->skip = NextSkip();
+}
+
+// each weighted update is admitted whole with probability p
+void SampledSketch::Add(uint64_t x, int64_t delta) {
+    assert(delta >= 0);
+    this->m += delta;
+    this->weight_squares += double(delta) * delta;
+
+    if (this->skip > 0) {
+        this->skip--;
+        return;
+    }
+    this->inner.Add(x, delta);
+    this->skip = NextSkip();
+}
+
+// unbiased: E[admitted count] = p * f
+uint64_t SampledSketch::Estimate(uint64_t x) {
+    return std::llround(this->inner.Estimate(x) / this->p);
+}
+
+bool SampledSketch::IsCandidate(uint64_t x) {
+    return this->inner.IsCandidate(x);
+}
+
+void SampledSketch::Candidates(HeavyHitterList& out, uint64_t threshold) {
+    size_t begin = out.size();
+    CandidatesOf(this->inner, out, threshold * this->p);
+    for (size_t i = begin; i < out.size(); i++) {
+        out[i].estimate = std::llround(out[i].estimate / this->p);
+    }
+}
+
+size_t SampledSketch::Size() {
+    return sizeof(*this) + this->inner.Size();
+}
+
+// inner error scaled up by 1/p, plus SAMPLING_Z standard deviations of the
+// sampled count: updates w_i admitted whole give Var[admitted/p] = Σw_i²(1 - p)/p
+// over x's updates, at most weight_squares(1 - p)/p (m(1 - p)/p for unit updates)
+double SampledSketch::ErrorBound() {
+    return this->inner.ErrorBound() / this->p
+        + SAMPLING_Z * std::sqrt(this->weight_squares * (1 - this->p) / this->p);
+}
@@ -0,0 +1,48 @@
+#include "sketch.hpp"
+#include <algorithm>
+
+HeavyHitterList Sketch::HeavyHitters(double phi) {
+    uint64_t threshold = PhiThreshold(phi, this->m);
+
+    HeavyHitterList hh;
+    Candidates(hh, threshold);
+    std::sort(hh.begin(), hh.end(), ByEstimate);
+
+    return hh;
+}
+
+std::vector<HeavyHitterList> Sketch::HeavyHitters(const std::vector<double>& phis) {
+    std::vector<HeavyHitterList> results(phis.size());
+    if (phis.empty()) {
+        return results;
+    }
+
+    // the lowest threshold's answer contains every other answer as a prefix
+    uint64_t lowest = PhiThreshold(*std::min_element(phis.begin(), phis.end()), this->m);
+    HeavyHitterList hh;
+    Candidates(hh, lowest);
+    std::sort(hh.begin(), hh.end(), ByEstimate);
+
+    for (size_t i = 0; i < phis.size(); i++) {
+        uint64_t threshold = PhiThreshold(phis[i], this->m);
+        auto last = std::partition_point(hh.begin(), hh.end(), [threshold](const HeavyHitter& h) {
+            return h.estimate >= threshold;
+        });
+        results[i].assign(hh.begin(), last);
+    }
+
+    return results;
+}
+
+HeavyHitterList Sketch::TopK(size_t k) {
+    HeavyHitterList hh;
+    Candidates(hh, 0);
+
+    if (k < hh.size()) {
+        std::nth_element(hh.begin(), hh.begin() + k, hh.end(), ByEstimate);
+        hh.resize(k);
+    }
+    std::sort(hh.begin(), hh.end(), ByEstimate);
+
+    return hh;
+}
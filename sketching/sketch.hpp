@@ -2,13 +2,21 @@
 #define SKETCH_H
 
 #include <vector>
+#include <functional>
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <set>
+#include <queue>
+#include <string>
+#include <string_view>
 #include <cstdint>
 #include <random>
 #include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include "../hashutil.h"
 
 // assume no heavy hitter queries for phi < MIN_PHI
@@ -18,49 +26,152 @@ const double MIN_PHI = 0.001;
 const __uint128_t LARGE_PRIME = 0x1FFFFFFFFFFFFFFF;
 
 
+// an item and its estimated frequency
+struct HeavyHitter {
+    uint64_t key;
+    uint64_t estimate;
+};
+
+// query results, contiguous and sorted by descending estimate
+typedef std::vector<HeavyHitter> HeavyHitterList;
+
+// counter tables are cache line aligned, so with k ≥ 8 every row starts on its
+// own line and threads owning different rows never share one
+const size_t CACHE_LINE = 64;
+
+// zeroed, cache line aligned table of n 8-byte counters (release with free)
+inline void *AllocTable(uint64_t n) {
+    size_t bytes = (n * sizeof(uint64_t) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    void *table = aligned_alloc(CACHE_LINE, bytes);
+    assert(table);
+    memset(table, 0, bytes);
+    return table;
+}
+
+// smallest count that is ≥ phi*m (truncating would admit counts just under it)
+inline uint64_t PhiThreshold(double phi, uint64_t m) {
+    return std::ceil(phi * m);
+}
+
+// result order: descending estimate, ties broken by key so results are deterministic
+inline bool ByEstimate(const HeavyHitter& a, const HeavyHitter& b) {
+    return a.estimate > b.estimate || (a.estimate == b.estimate && a.key < b.key);
+}
+
+// a sketch dumped to disk by Save (see SketchFile)
+class SketchFile;
+
+// murmur3 64-bit finalizer, for spreading keys over open-addressing tables
+inline uint64_t Mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+
 class Sketch {
     public:
+        Sketch() : m(0) {}
+        virtual ~Sketch() {}
         // increments the count of item x by 1
         virtual void Add(uint64_t x) = 0;
+        // adds delta (a weight, or a deletion when negative) to the count of item x;
+        // assumes the strict turnstile model: no item's net count goes below 0
+        virtual void Add(uint64_t x, int64_t delta) = 0;
         // returns the estimated frequency of item x
         virtual uint64_t Estimate(uint64_t x) = 0;
+        // whether x is currently a heavy hitter candidate
+        virtual bool IsCandidate(uint64_t x) = 0;
         // calculates the phi-heavy hitters with frequency ≥ phi*N
-        virtual std::multimap<uint64_t, uint64_t, std::greater<uint64_t>> HeavyHitters(double phi) = 0;
+        HeavyHitterList HeavyHitters(double phi);
+        // heavy hitters for several thresholds over a single candidate scan, one list per phi
+        std::vector<HeavyHitterList> HeavyHitters(const std::vector<double>& phis);
+        // the k candidates with the highest estimated frequency
+        HeavyHitterList TopK(size_t k);
         // return the size of the sketch (allocated memory)
         virtual size_t Size() = 0;
-    private:
-        // stream size so far
+        // additive error bound on Estimate, holding with high probability
+        virtual double ErrorBound() = 0;
+        // stream size so far (net sum of deltas)
+        uint64_t StreamSize() { return m; }
+    protected:
+        // appends every heavy hitter candidate with estimate ≥ threshold
+        virtual void Candidates(HeavyHitterList& out, uint64_t threshold) = 0;
+        // for wrappers, which may only call Candidates on a sketch they wrap through the base
+        static void CandidatesOf(Sketch& sketch, HeavyHitterList& out, uint64_t threshold) {
+            sketch.Candidates(out, threshold);
+        }
+
+        // stream size so far (net sum of deltas)
         uint64_t m;
 };
 
 class MisraGries : public Sketch {
     public:
         MisraGries(uint64_t capacity);
+        // loads a dumped Misra-Gries sketch
+        MisraGries(const SketchFile& file);
+        // writes the counters to path in the SketchFile layout; false if it could not be written
+        bool Save(const char *path);
+        // adds other's counters, then subtracts the k-th largest so at most k - 1
+        // remain; the merged error stays within (inserted + other.inserted)/k
+        void Merge(const MisraGries& other);
+        void Merge(const SketchFile& file);
         void Add(uint64_t x) override;
+        void Add(uint64_t x, int64_t delta) override;
         uint64_t Estimate(uint64_t x) override;
-        std::multimap<uint64_t, uint64_t, std::greater<uint64_t>> HeavyHitters(double phi) override;
+        bool IsCandidate(uint64_t x) override;
         size_t Size() override;
+        double ErrorBound() override;
+    protected:
+        void Candidates(HeavyHitterList& out, uint64_t threshold) override;
     private:
-        // stream size so far
-        uint64_t m;
         // capacity
         uint64_t k;
         // { key : count } for up to k counters
         std::unordered_map<uint64_t, uint64_t> counters;
+        // total inserted weight: deletions lower m but not the undercount that
+        // decrements built up while the weight was inserted
+        uint64_t inserted;
+
+        void MergeCounters(const uint64_t *pairs, uint64_t n, uint64_t other_m, uint64_t other_inserted);
 };
 
 class CountSketch : public Sketch {
     public:
         // t = num hash functions, k = num counters per hash func 
-        CountSketch(uint64_t t, uint64_t k);
+        // sketches built with the same seed share hash coefficients, so they can be merged
+        CountSketch(uint64_t t, uint64_t k, uint64_t seed = std::random_device()());
+        // loads a dumped Count Sketch
+        CountSketch(const SketchFile& file);
         ~CountSketch();
+        // copies the counters, coefficients and candidates (for snapshots)
+        CountSketch(const CountSketch& other);
+        CountSketch& operator=(const CountSketch& other);
+        // row-partitioned parallel update: each of the threads owns a contiguous
+        // subset of the t rows and applies the whole batch to them, so no counter
+        // is written by two threads (at most t threads are used)
+        void AddBatch(const uint64_t *keys, uint64_t n, unsigned threads);
+        // adds other's counts into this sketch (same dimensions and hash coefficients,
+        // e.g. a copy made before either was updated)
+        void Merge(const CountSketch& other);
+        // same, reading the counters straight from a mapped dump
+        void Merge(const SketchFile& file);
+        // writes the counters, coefficients and candidates to path in the SketchFile layout;
+        // false if it could not be written
+        bool Save(const char *path);
         void Add(uint64_t x) override;
+        void Add(uint64_t x, int64_t delta) override;
         uint64_t Estimate(uint64_t x) override;
-        std::multimap<uint64_t, uint64_t, std::greater<uint64_t>> HeavyHitters(double phi) override;
+        bool IsCandidate(uint64_t x) override;
         size_t Size() override;
+        double ErrorBound() override;
+    protected:
+        void Candidates(HeavyHitterList& out, uint64_t threshold) override;
     private:
-        // stream size so far
-        uint64_t m;
         // rows ~ num hash funcs
         uint64_t t;
         // cols ~ num counter buckets
@@ -78,20 +189,43 @@ class CountSketch : public Sketch {
         inline uint64_t BucketHash(uint64_t x, uint64_t row);
         // second hash function for incrementing or decrementing the counter
         inline int8_t UpdateHash(uint64_t x, uint64_t row);
+
+        void MergeCounters(const int64_t *other_table, const uint64_t *other_coeffs, uint64_t other_m,
+                           const uint64_t *candidates, uint64_t c);
 };
 
 class CountMinSketch : public Sketch {
     public:
         // t = num hash functions, k = num counters (buckets per row)
-        CountMinSketch(uint64_t t, uint64_t k);
+        // sketches built with the same seed share hash coefficients, so they can be merged
+        CountMinSketch(uint64_t t, uint64_t k, uint64_t seed = std::random_device()());
+        // loads a dumped Count-Min sketch
+        CountMinSketch(const SketchFile& file);
         ~CountMinSketch();
+        // copies the counters, coefficients and candidates (for snapshots)
+        CountMinSketch(const CountMinSketch& other);
+        CountMinSketch& operator=(const CountMinSketch& other);
+        // row-partitioned parallel update: each of the threads owns a contiguous
+        // subset of the t rows and applies the whole batch to them, so no counter
+        // is written by two threads (at most t threads are used)
+        void AddBatch(const uint64_t *keys, uint64_t n, unsigned threads);
+        // adds other's counts into this sketch (same dimensions and hash coefficients,
+        // e.g. a copy made before either was updated)
+        void Merge(const CountMinSketch& other);
+        // same, reading the counters straight from a mapped dump
+        void Merge(const SketchFile& file);
+        // writes the counters, coefficients and candidates to path in the SketchFile layout;
+        // false if it could not be written
+        bool Save(const char *path);
         void Add(uint64_t x) override;
+        void Add(uint64_t x, int64_t delta) override;
         uint64_t Estimate(uint64_t x) override;
-        std::multimap<uint64_t, uint64_t, std::greater<uint64_t>> HeavyHitters(double phi) override;
+        bool IsCandidate(uint64_t x) override;
         size_t Size() override;
+        double ErrorBound() override;
+    protected:
+        void Candidates(HeavyHitterList& out, uint64_t threshold) override;
     private:
-        // total count of items seen
-        uint64_t m;
         // table rows ~ num hash funcs
         uint64_t t;
         // table cols ~ num counter buckets
@@ -107,6 +241,388 @@ class CountMinSketch : public Sketch {
 
         // hash function for assigning a counter to update in the row
         inline uint64_t BucketHash(uint64_t x, uint64_t row);
+
+        void MergeCounters(const uint64_t *other_table, const uint64_t *other_coeffs, uint64_t other_m,
+                           const uint64_t *candidates, uint64_t c);
+};
+
+// exact frequency counts (ground truth) in a flat open-addressing table,
+// split into radix partitions so batches can be counted in parallel
+class ExactCounter : public Sketch {
+    public:
+        // threads = workers used by AddBatch (0 = all hardware threads)
+        ExactCounter(unsigned threads = 0);
+        ~ExactCounter();
+        void Add(uint64_t x) override;
+        void Add(uint64_t x, int64_t delta) override;
+        // counts n items, radix-partitioned across the worker threads
+        void AddBatch(const uint64_t *keys, uint64_t n);
+        uint64_t Estimate(uint64_t x) override;
+        bool IsCandidate(uint64_t x) override;
+        size_t Size() override;
+        double ErrorBound() override;
+        // number of distinct items counted (including ones deleted back to 0)
+        uint64_t Distinct();
+
+        // sort-based fallback when even a flat table does not fit in memory:
+        // sorts keys in place and reports the runs of length ≥ phi*n
+        static HeavyHitterList SortedHeavyHitters(uint64_t *keys, uint64_t n, double phi);
+    protected:
+        // every counted item is a candidate
+        void Candidates(HeavyHitterList& out, uint64_t threshold) override;
+    private:
+        // one open-addressing table {key, count}[capacity] per radix partition
+        struct Partition {
+            uint64_t *slots;
+            uint64_t capacity;
+            uint64_t size;
+        };
+
+        // workers for batched counting
+        unsigned threads;
+        // tables, indexed by the high bits of the key hash
+        Partition *partitions;
+        // marks empty slots, so its own count is kept aside
+        uint64_t empty_key_count;
+
+        inline void Insert(Partition& p, uint64_t x, uint64_t h, int64_t delta);
+        void Grow(Partition& p);
+        void CountPartitions(const uint64_t *keys, const uint64_t *offsets, unsigned worker);
+};
+
+// one small Count-Min sketch per tenant, for hundreds of thousands of tenants:
+// every sketch shares one set of hash coefficients, and each lives in a fixed-size
+// slot carved out of huge-page-backed slabs, so create/evict/reset never malloc
+class SketchPool {
+    public:
+        // t = num hash functions, k = num counters per row (power of 2),
+        // candidates = heavy hitter candidates tracked per tenant,
+        // slots_per_slab = tenants per slab allocation
+        SketchPool(uint64_t t, uint64_t k, uint64_t candidates = 64, uint64_t slots_per_slab = 1024);
+        ~SketchPool();
+        // creates an empty sketch for tenant (no-op if it exists)
+        void Create(uint64_t tenant);
+        // releases tenant's slot for reuse
+        void Evict(uint64_t tenant);
+        // zeroes tenant's counters and candidates
+        void Reset(uint64_t tenant);
+        bool Contains(uint64_t tenant);
+        // adds delta to the count of item x for tenant, creating its sketch on first use
+        void Add(uint64_t tenant, uint64_t x, int64_t delta = 1);
+        // n updates routed by (tenant, key); deltas = nullptr for unit updates
+        void AddBatch(const uint64_t *tenants, const uint64_t *keys, const int64_t *deltas, uint64_t n);
+        uint64_t Estimate(uint64_t tenant, uint64_t x);
+        HeavyHitterList HeavyHitters(uint64_t tenant, double phi);
+        HeavyHitterList TopK(uint64_t tenant, size_t k);
+        // tenant's stream size so far (net sum of deltas)
+        uint64_t StreamSize(uint64_t tenant);
+        // memory attributable to tenant: its slot, its index entry and a share of the coefficients
+        size_t Size(uint64_t tenant);
+        // total allocated memory
+        size_t Size();
+        // number of live tenants
+        uint64_t Tenants();
+    private:
+        // table rows ~ num hash funcs
+        uint64_t t;
+        // table cols ~ num counter buckets
+        uint64_t k;
+        // candidate set capacity per tenant (power of 2, half full at most)
+        uint64_t c;
+        // words per slot {m, candidate count, weakest candidate estimate, table[t*k], candidate keys[c]},
+        // cache line aligned
+        uint64_t slot_words;
+        uint64_t slots_per_slab;
+
+        // hash coefficients {a, b}[], shared by every tenant
+        uint64_t *hash_coeffs;
+
+        // slabs of slots_per_slab slots each
+        std::vector<uint64_t*> slabs;
+        size_t slab_bytes;
+        // released slot ids
+        std::vector<uint64_t> free_slots;
+        // slots handed out so far, live or released
+        uint64_t next_slot;
+
+        // open-addressing index {tenant, slot id}[index_capacity]
+        uint64_t *index;
+        uint64_t index_capacity;
+        uint64_t tenants;
+
+        inline uint64_t *Slot(uint64_t id);
+        // slot id of tenant, or NO_SLOT
+        uint64_t Find(uint64_t tenant);
+        uint64_t FindOrCreate(uint64_t tenant);
+        void GrowIndex();
+        void ClearSlot(uint64_t *slot);
+
+        inline uint64_t BucketHash(uint64_t x, uint64_t row);
+        uint64_t Estimate(uint64_t *slot, uint64_t x);
+        void Update(uint64_t *slot, uint64_t x, int64_t delta);
+        // keeps x as a candidate if its estimate is ≥ MIN_PHI*m, pruning the set when full
+        void Track(uint64_t *slot, uint64_t x, uint64_t estimate);
+        void Candidates(uint64_t *slot, HeavyHitterList& out, uint64_t threshold);
+};
+
+// sketch dimensions chosen for a memory budget and an accuracy target
+struct SketchConfig {
+    enum Kind { COUNT_MIN, COUNT_SKETCH, MISRA_GRIES };
+
+    Kind kind;
+    // rows (hash functions); 1 for Misra-Gries
+    uint64_t t;
+    // counters per row (power of 2), or Misra-Gries capacity
+    uint64_t k;
+    // counter width; every sketch stores 64-bit counters, row-major
+    unsigned counter_bits;
+    // estimated table bytes
+    size_t bytes;
+    // per-update cost in ns: modeled from the kind and t, or measured by Measure
+    double cost;
+    // targeted additive error, as a fraction of N
+    double epsilon;
+    // false when no configuration met the accuracy target within the budget
+    // (the one with the smallest error bound that fits is returned instead)
+    bool meets_target;
+
+    std::unique_ptr<Sketch> Build() const;
+    // phi to query for full recall of phi-heavy hitters: Misra-Gries never
+    // overestimates, so its threshold is lowered by epsilon
+    double QueryPhi(double phi) const;
+    // times Add over n sample keys on a fresh sketch and replaces cost with the
+    // measured ns per update
+    double Measure(const uint64_t *sample, uint64_t n);
+
+    // fastest configuration whose table fits in budget_bytes and estimates
+    // within epsilon*N with probability 1 - delta, for phi-heavy hitter queries.
+    // skew = Zipf exponent of the stream if known (> 1 shrinks the tables),
+    // deletions = stream has negative deltas (rules out Misra-Gries).
+    // Speed is modeled unless sample_size keys of the stream are given, in which
+    // case every fitting configuration is timed on them (Measure) and ranked by that
+    static SketchConfig ForBudget(size_t budget_bytes, double phi, double epsilon, double delta,
+                                  double skew = 0, bool deletions = false,
+                                  const uint64_t *sample = nullptr, uint64_t sample_size = 0);
+    // same, targeting the data/unified cache of the given level (budget from sysfs)
+    static SketchConfig ForCache(int level, double phi, double epsilon, double delta,
+                                 double skew = 0, bool deletions = false,
+                                 const uint64_t *sample = nullptr, uint64_t sample_size = 0);
+    // size of the data/unified cache at level from sysfs (cpu0), 0 if unknown
+    static size_t CacheBytes(int level);
+};
+
+// a sketch dumped by Save, mapped read-only so loads and merges read the
+// counters straight from the page cache. Layout, in 8-byte words:
+//   header {MAGIC, kind, t, k, m, c, inserted, 0} (one cache line), then
+//   Count-Min:    table[t*k], coefficients {a, b}[t], candidate keys[c]
+//   Count Sketch: table[t*k], coefficients {a1, b1, a2, b2}[t], candidate keys[c]
+//   Misra-Gries:  {key, count}[c], with t = 1 and k = capacity
+class SketchFile {
+    public:
+        static const uint64_t MAGIC = 0x484354454b534848; // "HHSKETCH"
+        static const uint64_t HEADER_WORDS = 8;
+
+        // maps path; if it cannot be read or is not a well-formed dumped sketch,
+        // error says why and no other field may be used
+        SketchFile(const char *path);
+        ~SketchFile();
+        SketchFile(const SketchFile&) = delete;
+        SketchFile& operator=(const SketchFile&) = delete;
+
+        // asks the kernel to start reading the whole file in, e.g. for the next
+        // file while the current one is merged
+        void Prefetch() const;
+        size_t Bytes() const { return bytes; }
+        bool Valid() const { return error == nullptr; }
+        // same kind, dimensions and hash coefficients, so the two can be merged
+        bool Compatible(const SketchFile& other) const;
+
+        // nullptr once mapped and checked, else why the file was rejected
+        const char *error;
+
+        SketchConfig::Kind kind;
+        uint64_t t;
+        uint64_t k;
+        uint64_t m;
+        // candidates (Misra-Gries: counters)
+        uint64_t c;
+        // Misra-Gries: total inserted weight (header word 6), ≥ m under deletions
+        uint64_t inserted;
+        const uint64_t *table;
+        const uint64_t *hash_coeffs;
+        // candidate keys, or Misra-Gries {key, count} pairs
+        const uint64_t *candidates;
+
+        // writes a header and the given word arrays back to back to path; false
+        // (and nothing left at path) if the file could not be written
+        static bool Write(const char *path, SketchConfig::Kind kind, uint64_t t, uint64_t k, uint64_t m,
+                          uint64_t c, const std::vector<std::pair<const void*, uint64_t>>& arrays,
+                          uint64_t inserted = 0);
+
+        // merges the dumped sketches at paths (same kind, dimensions and seed) in a
+        // parallel tree reduction: each of the threads merges a contiguous run of
+        // files into its own sketch, then those are merged pairwise. The result is
+        // saved to out and returned for queries. Files that fail to load or do not
+        // match the first usable one are skipped, each reported as "path: reason"
+        // in rejected. Returns nullptr if no file was usable or out could not be written
+        static std::unique_ptr<Sketch> Reduce(const std::vector<std::string>& paths, const char *out,
+                                              unsigned threads, std::vector<std::string> *rejected = nullptr);
+    private:
+        const uint64_t *words;
+        size_t bytes;
+};
+
+// sampled ingestion for the highest-volume streams: each update reaches the
+// wrapped sketch with probability p, skipping rejected updates by a geometric
+// skip count (no RNG call per rejected key). Estimates are scaled by 1/p, m
+// counts every update, and the sampling variance is added to ErrorBound.
+// Insert-only: a deletion sampled independently of the insertion it undoes
+// could reach the inner sketch alone and break its strict turnstile model
+class SampledSketch : public Sketch {
+    public:
+        // inner = sketch counting the admitted updates (not owned), p = admission probability
+        SampledSketch(Sketch& inner, double p, uint64_t seed = std::random_device()());
+        void Add(uint64_t x) override;
+        // delta ≥ 0: weights only, no deletions
+        void Add(uint64_t x, int64_t delta) override;
+        uint64_t Estimate(uint64_t x) override;
+        bool IsCandidate(uint64_t x) override;
+        size_t Size() override;
+        double ErrorBound() override;
+    protected:
+        void Candidates(HeavyHitterList& out, uint64_t threshold) override;
+    private:
+        Sketch& inner;
+        // admission probability
+        double p;
+        // sum of squared weights of every update, for the sampling variance
+        double weight_squares;
+        // updates left to reject before the next admitted one
+        uint64_t skip;
+
+        std::mt19937_64 gen;
+        std::uniform_real_distribution<double> distrib_u;
+
+        // number of rejections before the next admission ~ Geometric(p)
+        inline uint64_t NextSkip();
+};
+
+// a key crossing a watched threshold phi*m
+struct ThresholdCrossing {
+    uint64_t key;
+    uint64_t estimate;
+    double phi;
+    // true: rose to ≥ phi*m, false: fell below it
+    bool rising;
+};
+
+// push-based heavy hitters: registered thresholds are maintained during Add,
+// so crossings are reported at the update that causes them instead of by
+// rescanning the candidates with HeavyHitters(phi).
+//
+// A key's rise is caught when its own update lifts its estimate to ≥ phi*m
+// (after deletions shrink m, a key left above it is reported at its next update).
+// Falls happen as m grows past a key's last estimate, so each threshold keeps
+// its keys in a min-heap of last-known estimates and only re-checks the ones
+// whose estimate phi*m has reached (one estimate each, amortized O(1) per
+// update). A key whose estimate drops without its own update (Misra-Gries
+// decrements, colliding deletions) is reported once phi*m passes the estimate
+// it was last seen with
+class ThresholdMonitor : public Sketch {
+    public:
+        typedef std::function<void(const ThresholdCrossing&)> Callback;
+
+        // inner = sketch counting the updates (not owned)
+        ThresholdMonitor(Sketch& inner);
+        // watches phi ≥ MIN_PHI; crossings go to callback, or to the Events() queue if there
+        // is none. Keys already above phi*m are reported as rising right away
+        void Watch(double phi, Callback callback = nullptr);
+        // drains the queued crossings of thresholds without a callback, oldest first
+        std::vector<ThresholdCrossing> Events();
+        // keys currently at or above phi*m of the i-th watched threshold, by last estimate
+        HeavyHitterList Above(size_t i);
+        void Add(uint64_t x) override;
+        void Add(uint64_t x, int64_t delta) override;
+        uint64_t Estimate(uint64_t x) override;
+        bool IsCandidate(uint64_t x) override;
+        size_t Size() override;
+        double ErrorBound() override;
+    protected:
+        void Candidates(HeavyHitterList& out, uint64_t threshold) override;
+    private:
+        // {scheduled estimate, key}, smallest estimate on top
+        typedef std::pair<uint64_t, uint64_t> Entry;
+
+        struct Watched {
+            uint64_t estimate;
+            // the key is re-checked once phi*m passes this; ≥ estimate only after a raise
+            uint64_t scheduled;
+        };
+
+        struct Threshold {
+            double phi;
+            Callback callback;
+            // keys above phi*m
+            std::unordered_map<uint64_t, Watched> above;
+            // the live entry {scheduled, key} of every key in above, plus superseded ones
+            // (skipped when popped), rebuilt once those outnumber the live ones
+            std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> falling;
+        };
+
+        Sketch& inner;
+        std::vector<Threshold> thresholds;
+        std::vector<ThresholdCrossing> events;
+
+        // checks every threshold after an update of x
+        inline void Check(uint64_t x);
+        // rise, fall or estimate refresh for x after its update
+        inline void Update(Threshold& w, uint64_t x, uint64_t estimate);
+        // re-checks the keys whose scheduled estimate phi*m has passed
+        void Expire(Threshold& w);
+        // (re)schedules key at estimate, superseding its older heap entry
+        void Schedule(Threshold& w, uint64_t key, uint64_t estimate);
+        void Report(Threshold& w, uint64_t key, uint64_t estimate, bool rising);
+};
+
+// an original byte-string key and its estimated frequency
+struct StringHeavyHitter {
+    std::string key;
+    uint64_t fingerprint;
+    uint64_t estimate;
+};
+
+// byte-string key front end for a 64-bit sketch: keys are hashed to fingerprints
+// with MurmurHash64A, and only the bytes of current heavy hitter candidates are
+// kept (back to back in one arena), so queries can return the real keys
+class StringKeySketch {
+    public:
+        // core = sketch counting the fingerprints (not owned)
+        StringKeySketch(Sketch& core, unsigned int seed = 0);
+        void Add(std::string_view key, int64_t delta = 1);
+        // hashes the whole batch first, then feeds the fingerprints to the core
+        void AddBatch(const std::string_view *keys, uint64_t n);
+        uint64_t Fingerprint(std::string_view key);
+        uint64_t Estimate(std::string_view key);
+        std::vector<StringHeavyHitter> HeavyHitters(double phi);
+        std::vector<StringHeavyHitter> TopK(size_t k);
+        // size of the kept keys (the core reports its own)
+        size_t Size();
+    private:
+        Sketch& core;
+        unsigned int seed;
+
+        // bytes of kept keys
+        std::string arena;
+        // arena size that triggers the next compaction
+        uint64_t compact_at;
+        // fingerprint -> {arena offset, length}
+        std::unordered_map<uint64_t, std::pair<uint64_t, uint64_t>> keys;
+
+        // keeps key's bytes while its fingerprint is a candidate
+        inline void Remember(uint64_t fingerprint, std::string_view key);
+        // drops keys that are no longer candidates and rewrites the arena
+        void Compact();
+        std::vector<StringHeavyHitter> Resolve(const HeavyHitterList& hh);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,250 @@
+#include "sketch.hpp"
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <string>
+
+// bytes per Misra-Gries counter: unordered_map node {next, key, count} + bucket pointer
+const size_t MG_COUNTER_BYTES = 5 * sizeof(uint64_t);
+// modeled ns per update, fit to Add timings on uniform and Zipf(1.5) streams
+// of 5M keys. Count-Min and Count Sketch hash each row to update and again to
+// re-estimate for candidate tracking (Count Sketch also hashes the sign and takes
+// a median); Misra-Gries mostly hits a counter on skewed streams, but without skew
+// most updates miss and churn the map through decrements. Pass a sample of the
+// stream to ForBudget to rank configurations by measured cost instead
+const double CMS_BASE_NS = 15;
+const double CMS_ROW_NS = 6;
+const double CS_BASE_NS = 30;
+const double CS_ROW_NS = 16;
+const double MG_SKEWED_NS = 27;
+const double MG_UNSKEWED_NS = 75;
+// cache sizes assumed when sysfs has no answer
+const size_t DEFAULT_CACHE_BYTES[] = {0, 32ULL << 10, 1ULL << 20, 8ULL << 20};
+
+static uint64_t NextPowerOf2(double x) {
+    uint64_t k = 1;
+    while (k < x) {
+        k *= 2;
+    }
+    return k;
+}
+
+// Riemann zeta(z) for z > 1: partial sum plus an integral tail
+static double Zeta(double z) {
+    const int TERMS = 1000;
+    double sum = 0;
+    for (int i = 1; i <= TERMS; i++) {
+        sum += std::pow(i, -z);
+    }
+    return sum + std::pow(TERMS, 1 - z) / (z - 1) - 0.5 * std::pow(TERMS, -z);
+}
+
+// For a Zipf(z) stream, z > 1, with f_i ≈ m i^-z / zeta(z), the mass left
+// after the k largest items is F1res(k) ≈ m k^(1-z) / (zeta(z)(z-1)) and
+// F2res(k) ≈ m^2 k^(1-2z) / (zeta(z)^2 (2z-1)). The tail-based error
+// bounds below are solved for the smallest k whose error is ≤ eps*m.
+
+// Count-Min: e/k * F1res(k)
+static double CountMinWidth(double epsilon, double skew) {
+    double uniform = M_E / epsilon;
+    if (skew <= 1) {
+        return uniform;
+    }
+    return std::min(uniform, std::pow(M_E / (epsilon * Zeta(skew) * (skew - 1)), 1 / skew));
+}
+
+// Count Sketch: sqrt(3 F2res(k) / k), and F2 ≤ m^2 without skew
+static double CountSketchWidth(double epsilon, double skew) {
+    double uniform = 3 / (epsilon * epsilon);
+    if (skew <= 1) {
+        return uniform;
+    }
+    double tail = 3 / (epsilon * epsilon * Zeta(skew) * Zeta(skew) * (2 * skew - 1));
+    return std::min(uniform, std::pow(tail, 1 / (2 * skew)));
+}
+
+// Misra-Gries: F1res(k/2) / (k/2), and m/k without skew
+static double MisraGriesCapacity(double epsilon, double skew) {
+    double uniform = 1 / epsilon + 1;
+    if (skew <= 1) {
+        return uniform;
+    }
+    return std::min(uniform, 2 * std::pow(1 / (epsilon * Zeta(skew) * (skew - 1)), 1 / skew) + 1);
+}
+
+static SketchConfig Make(SketchConfig::Kind kind, uint64_t t, uint64_t k, double epsilon, double skew) {
+    SketchConfig config;
+    config.kind = kind;
+    config.epsilon = epsilon;
+    config.t = t;
+    config.k = k;
+    config.counter_bits = 64;
+    config.meets_target = true;
+    switch (kind) {
+        case SketchConfig::COUNT_MIN:
+            config.bytes = t * k * sizeof(uint64_t) + t * 2 * sizeof(uint64_t);
+            config.cost = CMS_BASE_NS + CMS_ROW_NS * t;
+            break;
+        case SketchConfig::COUNT_SKETCH:
+            config.bytes = t * k * sizeof(int64_t) + t * 4 * sizeof(uint64_t);
+            config.cost = CS_BASE_NS + CS_ROW_NS * t;
+            break;
+        case SketchConfig::MISRA_GRIES:
+            config.bytes = k * MG_COUNTER_BYTES;
+            config.cost = skew > 1 ? MG_SKEWED_NS : MG_UNSKEWED_NS;
+            break;
+    }
+    return config;
+}
+
+// additive error of a configuration as a fraction of N, from the skew-free bounds
+static double ErrorFraction(const SketchConfig& config) {
+    switch (config.kind) {
+        case SketchConfig::COUNT_MIN:
+            return M_E / config.k;
+        case SketchConfig::COUNT_SKETCH:
+            return std::sqrt(3.0 / config.k);
+        case SketchConfig::MISRA_GRIES:
+            return 1.0 / config.k;
+    }
+    return 1;
+}
+
+// widest table of the kind that fits in budget_bytes, dropping rows (two at a
+// time for Count Sketch, to stay odd) if even k = 1 does not
+static SketchConfig Widest(SketchConfig::Kind kind, uint64_t t, size_t budget_bytes, double epsilon, double skew) {
+    if (kind == SketchConfig::MISRA_GRIES) {
+        return Make(kind, 1, std::max<uint64_t>(2, budget_bytes / MG_COUNTER_BYTES), epsilon, skew);
+    }
+    uint64_t step = kind == SketchConfig::COUNT_SKETCH ? 2 : 1;
+    uint64_t k = 1;
+    while (t > step && Make(kind, t, k, epsilon, skew).bytes > budget_bytes) {
+        t -= step;
+    }
+    while (Make(kind, t, 2 * k, epsilon, skew).bytes <= budget_bytes) {
+        k *= 2;
+    }
+    return Make(kind, t, k, epsilon, skew);
+}
+
+SketchConfig SketchConfig::ForBudget(size_t budget_bytes, double phi, double epsilon, double delta,
+                                     double skew, bool deletions, const uint64_t *sample, uint64_t sample_size) {
+    assert(epsilon > 0 && epsilon < phi);
+    assert(delta > 0 && delta < 1);
+
+    // rows for failure probability delta (odd, so Count Sketch has a true median)
+    uint64_t t = std::max(1.0, std::ceil(std::log(1 / delta)));
+    uint64_t t_odd = t | 1;
+
+    std::vector<SketchConfig> candidates = {
+        Make(COUNT_MIN, t, NextPowerOf2(CountMinWidth(epsilon, skew)), epsilon, skew),
+        Make(COUNT_SKETCH, t_odd, NextPowerOf2(CountSketchWidth(epsilon, skew)), epsilon, skew),
+    };
+    if (!deletions) {
+        candidates.push_back(Make(MISRA_GRIES, 1, std::ceil(MisraGriesCapacity(epsilon, skew)), epsilon, skew));
+    }
+
+    // cheapest per update among those that fit, then smallest
+    const SketchConfig *best = nullptr;
+    for (SketchConfig& config : candidates) {
+        if (config.bytes > budget_bytes) {
+            continue;
+        }
+        if (sample_size > 0) {
+            config.Measure(sample, sample_size);
+        }
+        if (!best || config.cost < best->cost || (config.cost == best->cost && config.bytes < best->bytes)) {
+            best = &config;
+        }
+    }
+    if (best) {
+        return *best;
+    }
+
+    // nothing meets the target: the widest table of each kind that fits, and
+    // whichever of those has the smallest error bound
+    std::vector<SketchConfig> widest = {
+        Widest(COUNT_MIN, t, budget_bytes, epsilon, skew),
+        Widest(COUNT_SKETCH, t_odd, budget_bytes, epsilon, skew),
+    };
+    if (!deletions) {
+        widest.push_back(Widest(MISRA_GRIES, 1, budget_bytes, epsilon, skew));
+    }
+    SketchConfig fallback = *std::min_element(widest.begin(), widest.end(),
+            [](const SketchConfig& a, const SketchConfig& b) {
+        return ErrorFraction(a) < ErrorFraction(b);
+    });
+    if (sample_size > 0) {
+        fallback.Measure(sample, sample_size);
+    }
+    fallback.meets_target = false;
+    return fallback;
+}
+
+SketchConfig SketchConfig::ForCache(int level, double phi, double epsilon, double delta,
+                                    double skew, bool deletions, const uint64_t *sample, uint64_t sample_size) {
+    assert(level >= 1 && level <= 3);
+    size_t budget = CacheBytes(level);
+    if (budget == 0) {
+        budget = DEFAULT_CACHE_BYTES[level];
+    }
+    return ForBudget(budget, phi, epsilon, delta, skew, deletions, sample, sample_size);
+}
+
+size_t SketchConfig::CacheBytes(int level) {
+    const std::string base = "/sys/devices/system/cpu/cpu0/cache/index";
+
+    for (int index = 0; ; index++) {
+        std::ifstream level_file(base + std::to_string(index) + "/level");
+        if (!level_file) {
+            return 0;
+        }
+        int cache_level;
+        std::string type, size;
+        level_file >> cache_level;
+        std::ifstream(base + std::to_string(index) + "/type") >> type;
+        std::ifstream(base + std::to_string(index) + "/size") >> size;
+        if (cache_level != level || type == "Instruction" || size.empty()) {
+            continue;
+        }
+
+        // e.g. "48K", "2048K", "30M"
+        size_t bytes = std::stoull(size);
+        switch (size.back()) {
+            case 'K': return bytes << 10;
+            case 'M': return bytes << 20;
+            case 'G': return bytes << 30;
+            default: return bytes;
+        }
+    }
+}
+
+double SketchConfig::QueryPhi(double phi) const {
+    return this->kind == MISRA_GRIES ? std::max(0.0, phi - this->epsilon) : phi;
+}
+
+double SketchConfig::Measure(const uint64_t *sample, uint64_t n) {
+    assert(n > 0);
+    std::unique_ptr<Sketch> sketch = Build();
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < n; i++) {
+        sketch->Add(sample[i]);
+    }
+    std::chrono::duration<double, std::nano> ns = std::chrono::steady_clock::now() - start;
+
+    this->cost = ns.count() / n;
+    return this->cost;
+}
+
+std::unique_ptr<Sketch> SketchConfig::Build() const {
+    switch (this->kind) {
+        case COUNT_MIN:
+            return std::unique_ptr<Sketch>(new CountMinSketch(this->t, this->k));
+        case COUNT_SKETCH:
+            return std::unique_ptr<Sketch>(new CountSketch(this->t, this->k));
+        case MISRA_GRIES:
+            return std::unique_ptr<Sketch>(new MisraGries(this->k));
+    }
+    return nullptr;
+}
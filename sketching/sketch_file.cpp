@@ -0,0 +1,214 @@
+#include "sketch.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+SketchFile::SketchFile(const char *path) : error(nullptr), words(nullptr), bytes(0) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        this->error = "cannot open";
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        this->error = "cannot stat";
+        return;
+    }
+    if ((uint64_t) st.st_size < HEADER_WORDS * sizeof(uint64_t)) {
+        close(fd);
+        this->error = "shorter than the header";
+        return;
+    }
+
+    void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        this->error = "cannot map";
+        return;
+    }
+    this->bytes = st.st_size;
+    // read once, front to back: aggressive readahead, pages dropped behind
+    madvise(map, this->bytes, MADV_SEQUENTIAL);
+    this->words = (const uint64_t*) map;
+
+    if (words[0] != MAGIC) {
+        this->error = "not a dumped sketch (bad magic)";
+        return;
+    }
+    if (words[1] > SketchConfig::MISRA_GRIES) {
+        this->error = "unknown sketch kind";
+        return;
+    }
+    this->kind = (SketchConfig::Kind) words[1];
+    this->t = words[2];
+    this->k = words[3];
+    this->m = words[4];
+    this->c = words[5];
+    this->inserted = words[6];
+
+    // bounded by the file size first, so the expected size below cannot overflow
+    uint64_t total = this->bytes / sizeof(uint64_t);
+    bool table = this->kind != SketchConfig::MISRA_GRIES;
+    if (t == 0 || k == 0 || t > total || k > total / t || c > total ||
+            (table && (k & (k - 1)) != 0) || (!table && t != 1)) {
+        this->error = "bad dimensions in header";
+        return;
+    }
+
+    uint64_t expected = HEADER_WORDS;
+    if (table) {
+        this->table = words + HEADER_WORDS;
+        this->hash_coeffs = this->table + t * k;
+        this->candidates = this->hash_coeffs + t * (this->kind == SketchConfig::COUNT_MIN ? 2 : 4);
+        expected = this->candidates + c - words;
+    } else {
+        this->table = nullptr;
+        this->hash_coeffs = nullptr;
+        this->candidates = words + HEADER_WORDS;
+        expected += 2 * c;
+    }
+    if (this->bytes != expected * sizeof(uint64_t)) {
+        this->error = "size does not match the header";
+        return;
+    }
+}
+
+SketchFile::~SketchFile() {
+    if (this->words) {
+        munmap((void*) this->words, this->bytes);
+    }
+    this->words = nullptr;
+}
+
+bool SketchFile::Compatible(const SketchFile& other) const {
+    if (this->kind != other.kind || this->t != other.t || this->k != other.k) {
+        return false;
+    }
+    if (this->kind == SketchConfig::MISRA_GRIES) {
+        return true;
+    }
+    uint64_t coeffs = this->t * (this->kind == SketchConfig::COUNT_MIN ? 2 : 4);
+    return memcmp(this->hash_coeffs, other.hash_coeffs, coeffs * sizeof(uint64_t)) == 0;
+}
+
+void SketchFile::Prefetch() const {
+    madvise((void*) this->words, this->bytes, MADV_WILLNEED);
+}
+
+// written to path.tmp and renamed into place, so a reducer scanning the
+// directory never maps a half-written sketch
+bool SketchFile::Write(const char *path, SketchConfig::Kind kind, uint64_t t, uint64_t k, uint64_t m,
+                       uint64_t c, const std::vector<std::pair<const void*, uint64_t>>& arrays,
+                       uint64_t inserted) {
+    std::string tmp = std::string(path) + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+
+    uint64_t header[HEADER_WORDS] = {MAGIC, kind, t, k, m, c, inserted, 0};
+    fwrite(header, sizeof(uint64_t), HEADER_WORDS, f);
+    for (const auto& [data, n] : arrays) {
+        fwrite(data, sizeof(uint64_t), n, f);
+    }
+    bool failed = ferror(f);
+    failed |= fclose(f) != 0;
+    if (failed || rename(tmp.c_str(), path) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+template <class S>
+static std::unique_ptr<Sketch> ReduceAs(std::vector<std::unique_ptr<SketchFile>>& files, const char *out,
+                                        unsigned threads) {
+    uint64_t n = files.size();
+    threads = std::max<uint64_t>(1, std::min<uint64_t>(threads, n));
+    std::vector<std::unique_ptr<S>> partial(threads);
+    std::vector<std::thread> workers;
+
+    // 1. worker w merges files [n*w/threads, n*(w+1)/threads) into its own sketch,
+    //    prefetching each file while the previous one is merged
+    for (unsigned w = 0; w < threads; w++) {
+        workers.emplace_back([&files, &partial, n, threads, w]() {
+            uint64_t first = n * w / threads;
+            uint64_t last = n * (w + 1) / threads;
+
+            for (uint64_t i = first; i < last; i++) {
+                if (i + 1 < last) {
+                    files[i + 1]->Prefetch();
+                }
+                if (i == first) {
+                    partial[w].reset(new S(*files[i]));
+                } else {
+                    partial[w]->Merge(*files[i]);
+                }
+                files[i].reset();
+            }
+        });
+    }
+    for (auto& worker : workers) worker.join();
+
+    // 2. pairwise: partial[w] absorbs partial[w + stride], log2(threads) rounds
+    for (unsigned stride = 1; stride < threads; stride *= 2) {
+        workers.clear();
+        for (unsigned w = 0; w + stride < threads; w += 2 * stride) {
+            workers.emplace_back([&partial, w, stride]() {
+                partial[w]->Merge(*partial[w + stride]);
+                partial[w + stride].reset();
+            });
+        }
+        for (auto& worker : workers) worker.join();
+    }
+
+    if (!partial[0]->Save(out)) {
+        return nullptr;
+    }
+    return std::move(partial[0]);
+}
+
+std::unique_ptr<Sketch> SketchFile::Reduce(const std::vector<std::string>& paths, const char *out,
+                                           unsigned threads, std::vector<std::string> *rejected) {
+    // every file is mapped and checked against the first usable one up front, so
+    // a bad file is skipped here rather than failing a worker mid-merge
+    std::vector<std::unique_ptr<SketchFile>> files;
+    std::string first;
+    for (const std::string& path : paths) {
+        std::unique_ptr<SketchFile> file(new SketchFile(path.c_str()));
+        std::string why;
+        if (!file->Valid()) {
+            why = file->error;
+        } else if (!files.empty() && !file->Compatible(*files[0])) {
+            why = "kind, dimensions or seed differ from " + first;
+        }
+        if (!why.empty()) {
+            if (rejected) {
+                rejected->push_back(path + ": " + why);
+            }
+            continue;
+        }
+        if (files.empty()) {
+            first = path;
+        }
+        files.push_back(std::move(file));
+    }
+    if (files.empty()) {
+        return nullptr;
+    }
+
+    switch (files[0]->kind) {
+        case SketchConfig::COUNT_MIN:
+            return ReduceAs<CountMinSketch>(files, out, threads);
+        case SketchConfig::COUNT_SKETCH:
+            return ReduceAs<CountSketch>(files, out, threads);
+        case SketchConfig::MISRA_GRIES:
+            return ReduceAs<MisraGries>(files, out, threads);
+    }
+    return nullptr;
+}
@@ -0,0 +1,413 @@
+#include "sketch.hpp"
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+
+// slot header {m, candidate count, weakest candidate estimate}, padded to a cache
+// line so every table is aligned
+const uint64_t HEADER_WORDS = 8;
+const uint64_t WORDS_PER_LINE = 8;
+// slabs are rounded up to whole huge pages
+const size_t HUGE_PAGE = 2ULL << 20;
+const uint64_t INITIAL_INDEX_CAPACITY = 1024;
+// marks an empty index entry or candidate
+const uint64_t EMPTY_KEY = UINT64_MAX;
+const uint64_t NO_SLOT = UINT64_MAX;
+
+
+SketchPool::SketchPool(uint64_t t, uint64_t k, uint64_t candidates, uint64_t slots_per_slab)
+        : t(t), k(k), slots_per_slab(slots_per_slab), next_slot(0), tenants(0) {
+    // k must be power of 2 for efficient hashing techniques
+    assert((k & (k - 1)) == 0 && k > 0);
+    assert(candidates > 0 && slots_per_slab > 0);
+
+    // candidate set is kept at most half full
+    this->c = 1;
+    while (this->c < 2 * candidates) {
+        this->c *= 2;
+    }
+
+    uint64_t words = HEADER_WORDS + t * k + this->c;
+    this->slot_words = (words + WORDS_PER_LINE - 1) / WORDS_PER_LINE * WORDS_PER_LINE;
+    size_t bytes = this->slots_per_slab * this->slot_words * sizeof(uint64_t);
+    this->slab_bytes = (bytes + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+
+    this->index_capacity = INITIAL_INDEX_CAPACITY;
+    this->index = (uint64_t*) malloc(this->index_capacity * 2 * sizeof(uint64_t));
+    memset(this->index, 0xFF, this->index_capacity * 2 * sizeof(uint64_t));
+
+    this->hash_coeffs = (uint64_t*) malloc(t * 2 * sizeof(uint64_t));
+
+    // coefficients for t pairwise independent hash functions, shared by every tenant
+
+    std::random_device rd;
+    std::mt19937_64 gen(rd());
+    std::uniform_int_distribution<uint64_t> distrib_a(1ULL, LARGE_PRIME - 1ULL); // 0 < a < p
+    std::uniform_int_distribution<uint64_t> distrib_b(0ULL, LARGE_PRIME - 1ULL); // 0 ≤ b < p
+
+    for (uint64_t i = 0; i < 2*t; i+=2) {
+        hash_coeffs[i] = distrib_a(gen);
+        hash_coeffs[i + 1] = distrib_b(gen);
+    }
+}
+
+SketchPool::~SketchPool() {
+    for (uint64_t *slab : this->slabs) {
+        munmap(slab, this->slab_bytes);
+    }
+
+    free(this->index);
+    this->index = nullptr;
+
+    free(this->hash_coeffs);
+    this->hash_coeffs = nullptr;
+}
+
+inline uint64_t *SketchPool::Slot(uint64_t id) {
+    return slabs[id / this->slots_per_slab] + (id % this->slots_per_slab) * this->slot_words;
+}
+
+void SketchPool::ClearSlot(uint64_t *slot) {
+    memset(slot, 0, (HEADER_WORDS + this->t * this->k) * sizeof(uint64_t));
+    memset(slot + HEADER_WORDS + this->t * this->k, 0xFF, this->c * sizeof(uint64_t));
+}
+
+uint64_t SketchPool::Find(uint64_t tenant) {
+    // reserved for empty index entries, so never a tenant
+    if (tenant == EMPTY_KEY) {
+        return NO_SLOT;
+    }
+    uint64_t mask = this->index_capacity - 1;
+    for (uint64_t i = Mix(tenant) & mask; index[2 * i] != EMPTY_KEY; i = (i + 1) & mask) {
+        if (index[2 * i] == tenant) {
+            return index[2 * i + 1];
+        }
+    }
+    return NO_SLOT;
+}
+
+void SketchPool::GrowIndex() {
+    uint64_t *old = this->index;
+    uint64_t old_capacity = this->index_capacity;
+
+    this->index_capacity *= 2;
+    this->index = (uint64_t*) malloc(this->index_capacity * 2 * sizeof(uint64_t));
+    memset(this->index, 0xFF, this->index_capacity * 2 * sizeof(uint64_t));
+    uint64_t mask = this->index_capacity - 1;
+
+    for (uint64_t i = 0; i < old_capacity; i++) {
+        if (old[2 * i] == EMPTY_KEY) {
+            continue;
+        }
+        uint64_t j = Mix(old[2 * i]) & mask;
+        while (index[2 * j] != EMPTY_KEY) {
+            j = (j + 1) & mask;
+        }
+        index[2 * j] = old[2 * i];
+        index[2 * j + 1] = old[2 * i + 1];
+    }
+
+    free(old);
+}
+
+uint64_t SketchPool::FindOrCreate(uint64_t tenant) {
+    // reserved for empty index entries
+    assert(tenant != EMPTY_KEY);
+
+    uint64_t id = Find(tenant);
+    if (id != NO_SLOT) {
+        return id;
+    }
+
+    // reuse a released slot, else carve the next one (mapping a new slab when needed)
+    if (!this->free_slots.empty()) {
+        id = this->free_slots.back();
+        this->free_slots.pop_back();
+    } else {
+        if (this->next_slot == this->slabs.size() * this->slots_per_slab) {
+            void *slab = mmap(nullptr, this->slab_bytes, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (slab == MAP_FAILED) {
+                // no reserved huge pages: fall back to transparent huge pages
+                slab = mmap(nullptr, this->slab_bytes, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                assert(slab != MAP_FAILED);
+                madvise(slab, this->slab_bytes, MADV_HUGEPAGE);
+            }
+            this->slabs.push_back((uint64_t*) slab);
+        }
+        id = this->next_slot++;
+    }
+    ClearSlot(Slot(id));
+
+    // keep index load factor ≤ 0.5
+    if ((this->tenants + 1) * 2 > this->index_capacity) {
+        GrowIndex();
+    }
+    uint64_t mask = this->index_capacity - 1;
+    uint64_t i = Mix(tenant) & mask;
+    while (index[2 * i] != EMPTY_KEY) {
+        i = (i + 1) & mask;
+    }
+    index[2 * i] = tenant;
+    index[2 * i + 1] = id;
+    this->tenants++;
+
+    return id;
+}
+
+void SketchPool::Create(uint64_t tenant) {
+    FindOrCreate(tenant);
+}
+
+void SketchPool::Evict(uint64_t tenant) {
+    // reserved for empty index entries: it would match the first empty one
+    if (tenant == EMPTY_KEY) {
+        return;
+    }
+    uint64_t mask = this->index_capacity - 1;
+    uint64_t i = Mix(tenant) & mask;
+    while (index[2 * i] != tenant) {
+        if (index[2 * i] == EMPTY_KEY) {
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    this->free_slots.push_back(index[2 * i + 1]);
+    this->tenants--;
+
+    // backward-shift deletion keeps probe sequences intact without tombstones
+    uint64_t j = i;
+    while (true) {
+        index[2 * i] = EMPTY_KEY;
+        while (true) {
+            j = (j + 1) & mask;
+            if (index[2 * j] == EMPTY_KEY) {
+                return;
+            }
+            uint64_t home = Mix(index[2 * j]) & mask;
+            // entry j may move to i only if its home is not in (i, j]
+            if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j))) {
+                break;
+            }
+        }
+        index[2 * i] = index[2 * j];
+        index[2 * i + 1] = index[2 * j + 1];
+        i = j;
+    }
+}
+
+// Find returns NO_SLOT for EMPTY_KEY
+void SketchPool::Reset(uint64_t tenant) {
+    uint64_t id = Find(tenant);
+    if (id != NO_SLOT) {
+        ClearSlot(Slot(id));
+    }
+}
+
+bool SketchPool::Contains(uint64_t tenant) {
+    return Find(tenant) != NO_SLOT;
+}
+
+inline uint64_t SketchPool::BucketHash(uint64_t x, uint64_t row) {
+    uint64_t a1 = hash_coeffs[row * 2];
+    uint64_t b1 = hash_coeffs[row * 2 + 1];
+
+    // cast up to avoid overflow
+    __uint128_t u = (__uint128_t)a1 * x + b1;
+
+    // high order bits: u / 2^89
+    __uint128_t hi = u >> 89;
+    // low order bits: u % 2^89
+    __uint128_t lo = u & LARGE_PRIME;
+
+    // hi + lo < LARGE_PRIME, and (hi + lo) ≡ u (mod LARGE_PRIME)
+    __uint128_t hash = hi + lo;
+
+    // map hash to a counter bucket [0, k)
+    hash = hash & (this->k - 1); // hash % k, assuming k is a power of 2
+
+    return (uint64_t)hash;
+}
+
+// min of t hashed counters
+uint64_t SketchPool::Estimate(uint64_t *slot, uint64_t x) {
+    uint64_t *table = slot + HEADER_WORDS;
+    uint64_t min = UINT64_MAX;
+    for (uint64_t row = 0; row < this->t; row++) {
+        min = std::min(min, table[row * this->k + BucketHash(x, row)]);
+    }
+    return min;
+}
+
+void SketchPool::Track(uint64_t *slot, uint64_t x, uint64_t estimate) {
+    // reserved for empty candidates
+    if (x == EMPTY_KEY || estimate < slot[0] * MIN_PHI) {
+        return;
+    }
+
+    uint64_t *keys = slot + HEADER_WORDS + this->t * this->k;
+    uint64_t mask = this->c - 1;
+    uint64_t i = Mix(x) & mask;
+    for (; keys[i] != EMPTY_KEY; i = (i + 1) & mask) {
+        if (keys[i] == x) {
+            return;
+        }
+    }
+    if (slot[1] < this->c / 2) {
+        keys[i] = x;
+        slot[1]++;
+        return;
+    }
+
+    // full: counters only grow on insertion and Update clears the cache on a deletion,
+    // so no candidate has dropped below the cached weakest estimate, and x cannot beat it
+    if (estimate <= slot[2]) {
+        return;
+    }
+
+    // drop candidates that fell under MIN_PHI*m, else the weakest one if x beats it
+    HeavyHitterList kept;
+    Candidates(slot, kept, slot[0] * MIN_PHI);
+    auto by_estimate = [](const HeavyHitter& a, const HeavyHitter& b) {
+        return a.estimate < b.estimate;
+    };
+    if (kept.size() == slot[1]) {
+        auto weakest = std::min_element(kept.begin(), kept.end(), by_estimate);
+        if (weakest->estimate >= estimate) {
+            slot[2] = weakest->estimate;
+            return;
+        }
+        kept.erase(weakest);
+    }
+    kept.push_back({x, estimate});
+    slot[2] = kept.size() < this->c / 2 ? 0 : std::min_element(kept.begin(), kept.end(), by_estimate)->estimate;
+
+    memset(keys, 0xFF, this->c * sizeof(uint64_t));
+    for (const HeavyHitter& h : kept) {
+        uint64_t j = Mix(h.key) & mask;
+        while (keys[j] != EMPTY_KEY) {
+            j = (j + 1) & mask;
+        }
+        keys[j] = h.key;
+    }
+    slot[1] = kept.size();
+}
+
+void SketchPool::Update(uint64_t *slot, uint64_t x, int64_t delta) {
+    uint64_t *table = slot + HEADER_WORDS;
+    uint64_t min = UINT64_MAX;
+    for (uint64_t row = 0; row < this->t; row++) {
+        uint64_t& counter = table[row * this->k + BucketHash(x, row)];
+        counter += delta;
+        min = std::min(min, counter);
+    }
+
+    slot[0] += delta;
+
+    // working heavy hitter candidates (stale ones are filtered at query time);
+    // a deletion may lower any candidate's estimate, so the cached weakest goes
+    if (delta > 0) {
+        Track(slot, x, min);
+    } else if (delta < 0) {
+        slot[2] = 0;
+    }
+}
+
+void SketchPool::Add(uint64_t tenant, uint64_t x, int64_t delta) {
+    Update(Slot(FindOrCreate(tenant)), x, delta);
+}
+
+void SketchPool::AddBatch(const uint64_t *tenants, const uint64_t *keys, const int64_t *deltas, uint64_t n) {
+    // route: group updates by slot so each tenant's table is touched in one run
+    std::vector<std::pair<uint64_t, uint64_t>> routes(n);
+    uint64_t last_tenant = EMPTY_KEY, last_id = NO_SLOT;
+    for (uint64_t i = 0; i < n; i++) {
+        if (tenants[i] != last_tenant) {
+            last_tenant = tenants[i];
+            last_id = FindOrCreate(last_tenant);
+        }
+        routes[i] = {last_id, i};
+    }
+    std::sort(routes.begin(), routes.end());
+
+    uint64_t *slot = nullptr;
+    last_id = NO_SLOT;
+    for (const auto& [id, i] : routes) {
+        if (id != last_id) {
+            last_id = id;
+            slot = Slot(id);
+        }
+        Update(slot, keys[i], deltas ? deltas[i] : 1);
+    }
+}
+
+uint64_t SketchPool::Estimate(uint64_t tenant, uint64_t x) {
+    uint64_t id = Find(tenant);
+    return id != NO_SLOT ? Estimate(Slot(id), x) : 0;
+}
+
+void SketchPool::Candidates(uint64_t *slot, HeavyHitterList& out, uint64_t threshold) {
+    uint64_t *keys = slot + HEADER_WORDS + this->t * this->k;
+    for (uint64_t i = 0; i < this->c; i++) {
+        if (keys[i] == EMPTY_KEY) {
+            continue;
+        }
+        uint64_t count = Estimate(slot, keys[i]);
+        if (count >= threshold) {
+            out.push_back({keys[i], count});
+        }
+    }
+}
+
+HeavyHitterList SketchPool::HeavyHitters(uint64_t tenant, double phi) {
+    HeavyHitterList hh;
+    uint64_t id = Find(tenant);
+    if (id == NO_SLOT) {
+        return hh;
+    }
+
+    uint64_t *slot = Slot(id);
+    Candidates(slot, hh, PhiThreshold(phi, slot[0]));
+    std::sort(hh.begin(), hh.end(), ByEstimate);
+
+    return hh;
+}
+
+HeavyHitterList SketchPool::TopK(uint64_t tenant, size_t k) {
+    HeavyHitterList hh;
+    uint64_t id = Find(tenant);
+    if (id == NO_SLOT) {
+        return hh;
+    }
+
+    Candidates(Slot(id), hh, 0);
+    if (k < hh.size()) {
+        std::nth_element(hh.begin(), hh.begin() + k, hh.end(), ByEstimate);
+        hh.resize(k);
+    }
+    std::sort(hh.begin(), hh.end(), ByEstimate);
+
+    return hh;
+}
+
+uint64_t SketchPool::StreamSize(uint64_t tenant) {
+    uint64_t id = Find(tenant);
+    return id != NO_SLOT ? Slot(id)[0] : 0;
+}
+
+uint64_t SketchPool::Tenants() {
+    return this->tenants;
+}
+
+size_t SketchPool::Size(uint64_t tenant) {
+    if (Find(tenant) == NO_SLOT) {
+        return 0;
+    }
+    return (this->slot_words + 2 * this->index_capacity / this->tenants + 2 * this->t / this->tenants) * sizeof(uint64_t);
+}
+
+size_t SketchPool::Size() {
+    return sizeof(*this) + this->slabs.size() * this->slab_bytes
+        + (this->index_capacity * 2 + this->t * 2 + this->free_slots.capacity()) * sizeof(uint64_t);
+}
@@ -0,0 +1,96 @@
+#include "sketch.hpp"
+#include "../hashutil.h"
+#include <algorithm>
+
+// keys hashed per AddBatch block, before any of them touches the core
+const uint64_t HASH_BLOCK = 256;
+// arena bytes before the first compaction
+const uint64_t MIN_COMPACT = 1ULL << 16;
+
+StringKeySketch::StringKeySketch(Sketch& core, unsigned int seed) : core(core), seed(seed), compact_at(MIN_COMPACT) {}
+
+uint64_t StringKeySketch::Fingerprint(std::string_view key) {
+    return MurmurHash64A(key.data(), key.size(), this->seed);
+}
+
+inline void StringKeySketch::Remember(uint64_t fingerprint, std::string_view key) {
+    if (this->keys.count(fingerprint) || !this->core.IsCandidate(fingerprint)) {
+        return;
+    }
+
+    this->keys[fingerprint] = {this->arena.size(), key.size()};
+    this->arena.append(key);
+
+    if (this->arena.size() >= this->compact_at) {
+        Compact();
+    }
+}
+
+void StringKeySketch::Compact() {
+    std::string compacted;
+    compacted.reserve(this->arena.size() / 2);
+
+    for (auto it = this->keys.begin(); it != this->keys.end(); ) {
+        if (!this->core.IsCandidate(it->first)) {
+            it = this->keys.erase(it);
+            continue;
+        }
+        uint64_t offset = compacted.size();
+        compacted.append(this->arena, it->second.first, it->second.second);
+        it->second.first = offset;
+        ++it;
+    }
+    this->arena.swap(compacted);
+
+    // amortized: the arena must double again before the next pass
+    this->compact_at = std::max(MIN_COMPACT, 2 * this->arena.size());
+}
+
+void StringKeySketch::Add(std::string_view key, int64_t delta) {
+    uint64_t fingerprint = Fingerprint(key);
+    this->core.Add(fingerprint, delta);
+    Remember(fingerprint, key);
+}
+
+void StringKeySketch::AddBatch(const std::string_view *keys, uint64_t n) {
+    uint64_t fingerprints[HASH_BLOCK];
+
+    for (uint64_t base = 0; base < n; base += HASH_BLOCK) {
+        uint64_t b = std::min(HASH_BLOCK, n - base);
+        for (uint64_t i = 0; i < b; i++) {
+            fingerprints[i] = MurmurHash64A(keys[base + i].data(), keys[base + i].size(), this->seed);
+        }
+        for (uint64_t i = 0; i < b; i++) {
+            this->core.Add(fingerprints[i]);
+            Remember(fingerprints[i], keys[base + i]);
+        }
+    }
+}
+
+uint64_t StringKeySketch::Estimate(std::string_view key) {
+    return this->core.Estimate(Fingerprint(key));
+}
+
+std::vector<StringHeavyHitter> StringKeySketch::Resolve(const HeavyHitterList& hh) {
+    std::vector<StringHeavyHitter> resolved;
+    resolved.reserve(hh.size());
+    for (const HeavyHitter& h : hh) {
+        auto it = this->keys.find(h.key);
+        // (empty if the bytes were compacted away while it was briefly not a candidate)
+        std::string key = it != this->keys.end() ? this->arena.substr(it->second.first, it->second.second) : std::string();
+        resolved.push_back({key, h.key, h.estimate});
+    }
+    return resolved;
+}
+
+std::vector<StringHeavyHitter> StringKeySketch::HeavyHitters(double phi) {
+    return Resolve(this->core.HeavyHitters(phi));
+}
+
+std::vector<StringHeavyHitter> StringKeySketch::TopK(size_t k) {
+    return Resolve(this->core.TopK(k));
+}
+
+size_t StringKeySketch::Size() {
+    return sizeof(*this) + this->arena.capacity() + this->keys.size() * 3 * sizeof(uint64_t);
+}
@@ -0,0 +1,162 @@
+#include "sketch.hpp"
+#include <algorithm>
+
+ThresholdMonitor::ThresholdMonitor(Sketch& inner) : inner(inner) {
+    this->m = inner.StreamSize();
+}
+
+void ThresholdMonitor::Watch(double phi, Callback callback) {
+    assert(phi >= MIN_PHI);
+    this->thresholds.push_back({phi, callback, {}, {}});
+    Threshold& w = this->thresholds.back();
+
+    HeavyHitterList current;
+    CandidatesOf(this->inner, current, PhiThreshold(phi, this->m));
+    std::sort(current.begin(), current.end(), ByEstimate);
+    for (const HeavyHitter& h : current) {
+        Schedule(w, h.key, h.estimate);
+        Report(w, h.key, h.estimate, true);
+    }
+}
+
+std::vector<ThresholdCrossing> ThresholdMonitor::Events() {
+    std::vector<ThresholdCrossing> drained;
+    drained.swap(this->events);
+    return drained;
+}
+
+HeavyHitterList ThresholdMonitor::Above(size_t i) {
+    assert(i < this->thresholds.size());
+    HeavyHitterList hh;
+    for (const auto& [key, watched] : this->thresholds[i].above) {
+        hh.push_back({key, watched.estimate});
+    }
+    std::sort(hh.begin(), hh.end(), ByEstimate);
+    return hh;
+}
+
+void ThresholdMonitor::Add(uint64_t x) {
+    this->inner.Add(x);
+    this->m++;
+    Check(x);
+}
+
+void ThresholdMonitor::Add(uint64_t x, int64_t delta) {
+    this->inner.Add(x, delta);
+    this->m += delta;
+    Check(x);
+}
+
+// one estimate of x shared by every threshold, skipped when x is not a
+// candidate of the inner sketch: it is then below MIN_PHI*m ≤ phi*m, and if it
+// was above, Expire reports the fall once phi*m passes its last estimate
+inline void ThresholdMonitor::Check(uint64_t x) {
+    bool candidate = this->inner.IsCandidate(x);
+    uint64_t estimate = candidate ? this->inner.Estimate(x) : 0;
+    for (Threshold& w : this->thresholds) {
+        if (candidate) {
+            Update(w, x, estimate);
+        }
+        Expire(w);
+    }
+}
+
+// a raised estimate keeps its schedule (the lower heap entry surfaces first and
+// is refreshed then); one lowered under the schedule is rescheduled
+inline void ThresholdMonitor::Update(Threshold& w, uint64_t x, uint64_t estimate) {
+    uint64_t threshold = PhiThreshold(w.phi, this->m);
+    auto found = w.above.find(x);
+
+    if (found == w.above.end()) {
+        if (estimate >= threshold) {
+            Schedule(w, x, estimate);
+            Report(w, x, estimate, true);
+        }
+    } else if (estimate < threshold) {
+        w.above.erase(found);
+        Report(w, x, estimate, false);
+    } else if (estimate < found->second.scheduled) {
+        Schedule(w, x, estimate);
+    } else {
+        found->second.estimate = estimate;
+    }
+}
+
+// a key is re-estimated once phi*m passes its scheduled estimate e; if it is still
+// above, it is not re-checked until m grows by another (e' - phi*m)/phi. At
+// most 1/phi keys are above, each re-checked at most once per ~1/phi updates
+// while it sits at the threshold, so this is amortized O(1) estimates per update
+void ThresholdMonitor::Expire(Threshold& w) {
+    uint64_t threshold = PhiThreshold(w.phi, this->m);
+
+    while (!w.falling.empty() && w.falling.top().first < threshold) {
+        auto [scheduled, key] = w.falling.top();
+        w.falling.pop();
+
+        // superseded: the key already fell, or was rescheduled since
+        auto found = w.above.find(key);
+        if (found == w.above.end() || found->second.scheduled != scheduled) {
+            continue;
+        }
+
+        uint64_t estimate = this->inner.Estimate(key);
+        if (estimate >= threshold) {
+            Schedule(w, key, estimate);
+        } else {
+            w.above.erase(found);
+            Report(w, key, estimate, false);
+        }
+    }
+}
+
+// superseded entries are only dropped as they surface, so keys that dip and
+// recover (or rise and fall) repeatedly would grow the heap without bound;
+// rebuilding it from above once it is half garbage keeps it O(|above|),
+// amortized O(1) per push
+void ThresholdMonitor::Schedule(Threshold& w, uint64_t key, uint64_t estimate) {
+    w.above[key] = {estimate, estimate};
+    w.falling.push({estimate, key});
+
+    if (w.falling.size() > 2 * w.above.size()) {
+        std::vector<Entry> live;
+        live.reserve(w.above.size());
+        for (const auto& [k, watched] : w.above) {
+            live.push_back({watched.scheduled, k});
+        }
+        w.falling = decltype(w.falling)(std::greater<Entry>(), std::move(live));
+    }
+}
+
+void ThresholdMonitor::Report(Threshold& w, uint64_t key, uint64_t estimate, bool rising) {
+    ThresholdCrossing crossing = {key, estimate, w.phi, rising};
+    if (w.callback) {
+        w.callback(crossing);
+    } else {
+        this->events.push_back(crossing);
+    }
+}
+
+uint64_t ThresholdMonitor::Estimate(uint64_t x) {
+    return this->inner.Estimate(x);
+}
+
+bool ThresholdMonitor::IsCandidate(uint64_t x) {
+    return this->inner.IsCandidate(x);
+}
+
+void ThresholdMonitor::Candidates(HeavyHitterList& out, uint64_t threshold) {
+    CandidatesOf(this->inner, out, threshold);
+}
+
+// plus {key, estimate, scheduled} in above and {scheduled, key} in the heap for every watched key
+size_t ThresholdMonitor::Size() {
+    size_t size = sizeof(*this) + this->inner.Size() + this->events.capacity() * sizeof(ThresholdCrossing);
+    for (const Threshold& w : this->thresholds) {
+        size += sizeof(w) + (w.above.size() * 3 + w.falling.size() * 2) * sizeof(uint64_t);
+    }
+    return size;
+}
+
+double ThresholdMonitor::ErrorBound() {
+    return this->inner.ErrorBound();
+}